@@ -6,15 +6,37 @@
 
 #pragma once
 
+#include <zephyr/device.h>
+
 #define ZMK_BEHAVIOR_OPAQUE 0
 #define ZMK_BEHAVIOR_TRANSPARENT 1
 
 struct zmk_behavior_binding {
+    // Device name, used for split serialization and logging
     char *behavior_dev;
     uint32_t param1;
     uint32_t param2;
+    // Resolved device for behavior_dev, or NULL if it hasn't been looked up yet
+    const struct device *behavior;
 };
 
+/**
+ * @brief Get the behavior device of a binding.
+ *
+ * The device is looked up by name the first time and then cached in the binding, so bindings
+ * with persistent storage (keymap, combos, ...) only pay for the string lookup once.
+ *
+ * @retval Pointer to the behavior device, or NULL if no ready device has that name.
+ */
+static inline const struct device *
+zmk_behavior_binding_get_device(struct zmk_behavior_binding *binding) {
+    if (binding->behavior == NULL) {
+        binding->behavior = device_get_binding(binding->behavior_dev);
+    }
+
+    return binding->behavior;
+}
+
 struct zmk_behavior_binding_event {
     int layer;
     uint32_t position;
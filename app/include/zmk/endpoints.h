@@ -68,5 +68,47 @@ int zmk_endpoints_toggle_transport(void);
  */
 struct zmk_endpoint_instance zmk_endpoints_selected(void);
 
+/**
+ * Sends the current keyboard or consumer report to the selected endpoint. Reports identical to
+ * the last one sent to that endpoint are left out.
+ */
 int zmk_endpoints_send_report(uint16_t usage_page);
+
+struct zmk_endpoint_report_stats {
+    uint32_t sent;
+    uint32_t suppressed;
+};
+
+/**
+ * Gets the number of keyboard and consumer reports sent to an endpoint instance, and the number
+ * left out because the endpoint already had them.
+ */
+int zmk_endpoints_get_report_stats(struct zmk_endpoint_instance endpoint,
+                                   struct zmk_endpoint_report_stats *stats);
+
+/**
+ * Prints the report counters of every endpoint instance. Also available as the
+ * `zmk_endpoint_reports` shell command.
+ */
+void zmk_endpoints_print_report_stats(void);
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+/**
+ * Starts a batch of state changes. Until the matching zmk_endpoints_batch_end(),
+ * keyboard and consumer reports are only marked pending instead of being sent.
+ * Batches may be nested.
+ */
+void zmk_endpoints_batch_begin(void);
+
+/**
+ * Ends a batch and sends each pending report once with the latest state.
+ */
+int zmk_endpoints_batch_end(void);
+
+/**
+ * Sends any pending reports immediately, e.g. before a key is released, so the
+ * host never misses a press that happened earlier in the batch.
+ */
+int zmk_endpoints_flush_reports(void);
+#endif /* IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS) */
 int zmk_endpoints_send_mouse_report();
@@ -10,13 +10,31 @@
 #include <zephyr/kernel.h>
 #include <zephyr/types.h>
 
+/* Range of this event type's entries in the (type-grouped) subscription section */
+struct zmk_event_dispatch {
+    uint8_t first;
+    uint8_t count;
+};
+
+// Events of one type may be allocated from several threads, so the counters are atomic
+struct zmk_event_pool_stats {
+    atomic_t high_water;
+    atomic_t failures;
+};
+
 struct zmk_event_type {
     const char *name;
+    struct zmk_event_dispatch *dispatch;
+    struct k_mem_slab *pool;
+    struct zmk_event_pool_stats *pool_stats;
 };
 
 typedef struct {
     const struct zmk_event_type *event;
     uint8_t last_listener_index;
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+    uint32_t created_at;
+#endif
 } zmk_event_t;
 
 #define ZMK_EV_EVENT_BUBBLE 0
@@ -26,11 +44,39 @@ typedef struct {
 typedef int (*zmk_listener_callback_t)(const zmk_event_t *eh);
 struct zmk_listener {
     zmk_listener_callback_t callback;
+    // Disabled listeners are skipped when dispatching events, see zmk_event_manager_listener_*
+    bool *disabled;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_LISTENER_NAMES)
+    const char *name;
+#endif
+};
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING)
+// Results are counted as bubbled, handled, captured and error, in that order
+#define ZMK_LISTENER_STATS_RESULTS 4
+
+struct zmk_listener_stats {
+    uint32_t calls;
+    uint32_t worst_cycles;
+    uint64_t total_cycles;
+    uint32_t results[ZMK_LISTENER_STATS_RESULTS];
+};
+#endif
+
+// Chains subscriptions into a hash table keyed by event type and listener, so raise_after and
+// raise_at find where to start without searching. Each subscription also holds one bucket.
+struct zmk_event_subscription_slot {
+    uint8_t bucket;
+    uint8_t next;
 };
 
 struct zmk_event_subscription {
     const struct zmk_event_type *event_type;
     const struct zmk_listener *listener;
+    struct zmk_event_subscription_slot *slot;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING)
+    struct zmk_listener_stats *stats;
+#endif
 };
 
 #define ZMK_EVENT_DECLARE(event_type)                                                              \
@@ -42,14 +88,26 @@ struct zmk_event_subscription {
     struct event_type *as_##event_type(const zmk_event_t *eh);                                     \
     extern const struct zmk_event_type zmk_event_##event_type;
 
-#define ZMK_EVENT_IMPL(event_type)                                                                 \
-    const struct zmk_event_type zmk_event_##event_type = {.name = STRINGIFY(event_type)};          \
+#define ZMK_EVENT_IMPL_POOL(event_type, pool_size)                                                 \
+    K_MEM_SLAB_DEFINE_STATIC(zmk_event_pool_##event_type, sizeof(struct event_type##_event),       \
+                             pool_size, __alignof__(struct event_type##_event));                   \
+    static struct zmk_event_dispatch zmk_event_dispatch_##event_type;                              \
+    static struct zmk_event_pool_stats zmk_event_pool_stats_##event_type;                          \
+    const struct zmk_event_type zmk_event_##event_type = {                                         \
+        .name = STRINGIFY(event_type),                                                             \
+        .dispatch = &zmk_event_dispatch_##event_type,                                              \
+        .pool = &zmk_event_pool_##event_type,                                                      \
+        .pool_stats = &zmk_event_pool_stats_##event_type};                                         \
     const struct zmk_event_type *zmk_event_ref_##event_type __used                                 \
         __attribute__((__section__(".event_type"))) = &zmk_event_##event_type;                     \
     struct event_type##_event *new_##event_type(struct event_type data) {                          \
         struct event_type##_event *ev =                                                            \
-            (struct event_type##_event *)k_malloc(sizeof(struct event_type##_event));              \
+            (struct event_type##_event *)zmk_event_manager_alloc(&zmk_event_##event_type);         \
+        if (ev == NULL) {                                                                          \
+            return NULL;                                                                           \
+        }                                                                                          \
         ev->header.event = &zmk_event_##event_type;                                                \
+        IF_ENABLED(CONFIG_ZMK_LATENCY_TRACE, (ev->header.created_at = k_cycle_get_32();))          \
         ev->data = data;                                                                           \
         return ev;                                                                                 \
     };                                                                                             \
@@ -58,14 +116,41 @@ struct zmk_event_subscription {
                                                       : NULL;                                      \
     };
 
-#define ZMK_LISTENER(mod, cb) const struct zmk_listener zmk_listener_##mod = {.callback = cb};
+#define ZMK_EVENT_IMPL(event_type) ZMK_EVENT_IMPL_POOL(event_type, CONFIG_ZMK_EVENT_POOL_SIZE)
+
+#define ZMK_LISTENER_STATE(mod, cb, initially_disabled)                                            \
+    static bool zmk_listener_disabled_##mod = initially_disabled;                                  \
+    const struct zmk_listener zmk_listener_##mod = {                                               \
+        .callback = cb,                                                                            \
+        .disabled = &zmk_listener_disabled_##mod,                                                  \
+        IF_ENABLED(CONFIG_ZMK_EVENT_MANAGER_LISTENER_NAMES, (.name = STRINGIFY(mod)))};
+
+#define ZMK_LISTENER(mod, cb) ZMK_LISTENER_STATE(mod, cb, false)
 
+// A listener that is skipped until enabled with ZMK_LISTENER_ENABLE, for modules that only need
+// to see events while they have some state to track.
+#define ZMK_LISTENER_DISABLED(mod, cb) ZMK_LISTENER_STATE(mod, cb, true)
+
+#define ZMK_LISTENER_ENABLE(mod) zmk_event_manager_listener_enable(&zmk_listener_##mod)
+
+#define ZMK_LISTENER_DISABLE(mod) zmk_event_manager_listener_disable(&zmk_listener_##mod)
+
+// Subscriptions are grouped per event type at link time (see zmk-events.ld), keeping the
+// link order of listeners within each type.
 #define ZMK_SUBSCRIPTION(mod, ev_type)                                                             \
+    IF_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING,                                                 \
+               (static struct zmk_listener_stats _CONCAT(_CONCAT(zmk_event_sub_stats_, mod),       \
+                                                         ev_type);))                               \
+    static struct zmk_event_subscription_slot _CONCAT(_CONCAT(zmk_event_sub_slot_, mod),           \
+                                                      ev_type);                                    \
     const Z_DECL_ALIGN(struct zmk_event_subscription)                                              \
         _CONCAT(_CONCAT(zmk_event_sub_, mod), ev_type) __used                                      \
-        __attribute__((__section__(".event_subscription"))) = {                                    \
+        __attribute__((__section__(".event_subscription." STRINGIFY(ev_type)))) = {                \
             .event_type = &zmk_event_##ev_type,                                                    \
             .listener = &zmk_listener_##mod,                                                       \
+            .slot = &_CONCAT(_CONCAT(zmk_event_sub_slot_, mod), ev_type),                          \
+            IF_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING,                                         \
+                       (.stats = &_CONCAT(_CONCAT(zmk_event_sub_stats_, mod), ev_type), ))         \
     };
 
 #define ZMK_EVENT_RAISE(ev) zmk_event_manager_raise((zmk_event_t *)ev);
@@ -78,9 +163,21 @@ struct zmk_event_subscription {
 
 #define ZMK_EVENT_RELEASE(ev) zmk_event_manager_release((zmk_event_t *)ev);
 
-#define ZMK_EVENT_FREE(ev) k_free((void *)ev);
+#define ZMK_EVENT_FREE(ev) zmk_event_manager_free((zmk_event_t *)ev);
+
+void *zmk_event_manager_alloc(const struct zmk_event_type *type);
+void zmk_event_manager_free(zmk_event_t *event);
+void zmk_event_manager_print_pool_stats(void);
+void zmk_event_manager_print_listener_stats(void);
 
 int zmk_event_manager_raise(zmk_event_t *event);
 int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener);
 int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener);
-int zmk_event_manager_release(zmk_event_t *event);
\ No newline at end of file
+int zmk_event_manager_release(zmk_event_t *event);
+
+// Enabling or disabling a listener takes effect for all of its subscriptions, including events
+// that are already being dispatched but have yet to reach it. Raising an event at or after a
+// disabled listener is still allowed.
+void zmk_event_manager_listener_enable(const struct zmk_listener *listener);
+void zmk_event_manager_listener_disable(const struct zmk_listener *listener);
+bool zmk_event_manager_listener_is_enabled(const struct zmk_listener *listener);
\ No newline at end of file
@@ -18,11 +18,15 @@
 
 #define COLLECTION_REPORT 0x03
 
+#define ZMK_HID_REPORT_ID_KEYBOARD 0x01
+#define ZMK_HID_REPORT_ID_CONSUMER 0x02
+#define ZMK_HID_REPORT_ID_MOUSE 0x04
+
 static const uint8_t zmk_hid_report_desc[] = {
     HID_USAGE_PAGE(HID_USAGE_GEN_DESKTOP),
     HID_USAGE(HID_USAGE_GD_KEYBOARD),
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
-    HID_REPORT_ID(0x01),
+    HID_REPORT_ID(ZMK_HID_REPORT_ID_KEYBOARD),
     HID_USAGE_PAGE(HID_USAGE_KEY),
     HID_USAGE_MIN8(HID_USAGE_KEY_KEYBOARD_LEFTCONTROL),
     HID_USAGE_MAX8(HID_USAGE_KEY_KEYBOARD_RIGHT_GUI),
@@ -68,7 +72,7 @@ static const uint8_t zmk_hid_report_desc[] = {
     HID_USAGE_PAGE(HID_USAGE_CONSUMER),
     HID_USAGE(HID_USAGE_CONSUMER_CONSUMER_CONTROL),
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
-    HID_REPORT_ID(0x02),
+    HID_REPORT_ID(ZMK_HID_REPORT_ID_CONSUMER),
     HID_USAGE_PAGE(HID_USAGE_CONSUMER),
 
 #if IS_ENABLED(CONFIG_ZMK_HID_CONSUMER_REPORT_USAGES_BASIC)
@@ -99,7 +103,7 @@ static const uint8_t zmk_hid_report_desc[] = {
     /* COLLECTION (Application) */
     HID_COLLECTION(HID_COLLECTION_APPLICATION),
     /* REPORT ID (4) */
-    HID_REPORT_ID(0x04),
+    HID_REPORT_ID(ZMK_HID_REPORT_ID_MOUSE),
     /* USAGE (Pointer) */
     HID_USAGE(HID_USAGE_GD_POINTER),
     /* COLLECTION (Physical) */
@@ -217,6 +221,7 @@ struct zmk_hid_mouse_report {
 } __packed;
 
 zmk_mod_flags_t zmk_hid_get_explicit_mods();
+zmk_mod_flags_t zmk_hid_get_implicit_mods();
 int zmk_hid_register_mod(zmk_mod_t modifier);
 int zmk_hid_unregister_mod(zmk_mod_t modifier);
 bool zmk_hid_mod_is_pressed(zmk_mod_t modifier);
@@ -255,3 +260,11 @@ void zmk_hid_mouse_clear();
 struct zmk_hid_keyboard_report *zmk_hid_get_keyboard_report();
 struct zmk_hid_consumer_report *zmk_hid_get_consumer_report();
 struct zmk_hid_mouse_report *zmk_hid_get_mouse_report();
+
+/**
+ * Counters that change every time the keyboard or consumer report body changes. A report whose
+ * generation matches the one of a report sent earlier has the same contents. A different
+ * generation does not guarantee different contents, e.g. after a key is pressed and released again.
+ */
+uint32_t zmk_hid_keyboard_report_generation();
+uint32_t zmk_hid_consumer_report_generation();
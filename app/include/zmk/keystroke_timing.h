@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct zmk_keystroke {
+    int64_t timestamp;
+    uint32_t keycode;
+    uint16_t usage_page;
+    bool state;
+};
+
+// Get a recent keycode press or release, 0 being the most recent. Returns -ENOENT once the
+// history runs out.
+int zmk_keystroke_timing_get(int index, struct zmk_keystroke *keystroke);
+
+// Timestamp of the most recent non-modifier key press, or INT32_MIN if there was none.
+int64_t zmk_keystroke_timing_last_tap(void);
+
+// Timestamp of the most recent non-modifier key press that did not happen at `timestamp`, so a
+// behavior can leave out the keys it pressed itself.
+int64_t zmk_keystroke_timing_last_tap_except(int64_t timestamp);
+
+// Average interval between the non-modifier key presses of the current typing streak, or -1 if
+// the streak has fewer than two presses.
+int32_t zmk_keystroke_timing_average_interval(void);
+
+// Whether a non-modifier key was pressed within `idle_ms` before `timestamp`.
+static inline bool zmk_keystroke_timing_is_typing(int64_t timestamp, int32_t idle_ms) {
+    return (zmk_keystroke_timing_last_tap() + idle_ms) > timestamp;
+}
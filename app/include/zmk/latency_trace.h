@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zmk/event_manager.h>
+
+enum zmk_latency_stage {
+    ZMK_LATENCY_STAGE_KEYMAP,
+    ZMK_LATENCY_STAGE_REPORT,
+    ZMK_LATENCY_STAGE_COUNT,
+};
+
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+
+void zmk_latency_trace_listener_hop(const zmk_event_t *eh, const struct zmk_listener *listener);
+void zmk_latency_trace_keymap_begin(const zmk_event_t *eh);
+void zmk_latency_trace_keymap_end(void);
+void zmk_latency_trace_report_deferred(void);
+void zmk_latency_trace_reports_flushed(void);
+void zmk_latency_trace_report_sent(void);
+void zmk_latency_trace_dump(void);
+
+#else
+
+static inline void zmk_latency_trace_listener_hop(const zmk_event_t *eh,
+                                                  const struct zmk_listener *listener) {}
+static inline void zmk_latency_trace_keymap_begin(const zmk_event_t *eh) {}
+static inline void zmk_latency_trace_keymap_end(void) {}
+static inline void zmk_latency_trace_report_deferred(void) {}
+static inline void zmk_latency_trace_reports_flushed(void) {}
+static inline void zmk_latency_trace_report_sent(void) {}
+static inline void zmk_latency_trace_dump(void) {}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE) */
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/dlist.h>
+
+struct zmk_timer;
+
+typedef void (*zmk_timer_handler_t)(struct zmk_timer *timer);
+
+/**
+ * A behavior timeout. All timers share one timer wheel driven by a single kernel timeout on the
+ * input work queue, so starting and stopping them is cheap. Handlers run on the input work queue.
+ */
+struct zmk_timer {
+    sys_dnode_t node;
+    int64_t deadline;
+    zmk_timer_handler_t handler;
+};
+
+#define ZMK_TIMER_DEFINE(name, timer_handler) struct zmk_timer name = {.handler = timer_handler}
+
+void zmk_timer_init(struct zmk_timer *timer, zmk_timer_handler_t handler);
+
+/**
+ * (Re)start a timer to expire at `deadline`, in milliseconds of uptime. A deadline in the past
+ * expires as soon as the input work queue gets to it.
+ */
+void zmk_timer_start(struct zmk_timer *timer, int64_t deadline);
+
+/**
+ * Stop a timer. Once stopped, its handler will not be called until it is started again.
+ *
+ * @return true if the timer was running.
+ */
+bool zmk_timer_stop(struct zmk_timer *timer);
+
+static inline bool zmk_timer_is_running(const struct zmk_timer *timer) {
+    return sys_dnode_is_linked(&timer->node);
+}
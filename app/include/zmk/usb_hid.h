@@ -6,4 +6,24 @@
 
 #pragma once
 
-int zmk_usb_hid_send_report(const uint8_t *report, size_t len);
\ No newline at end of file
+#include <stddef.h>
+#include <stdint.h>
+
+struct zmk_usb_hid_stats {
+    // Reports that had to be queued because the host had yet to pick up the previous one
+    uint32_t stalls;
+    // Queued reports that were left out, replaced or merged into by a newer report with the same ID
+    uint32_t coalesced;
+};
+
+/**
+ * Sends a report, or queues it if the endpoint is busy. Never waits for the host.
+ */
+int zmk_usb_hid_send_report(const uint8_t *report, size_t len);
+
+void zmk_usb_hid_get_stats(struct zmk_usb_hid_stats *stats);
+
+/**
+ * Prints the report queue counters. Also available as the `zmk_usb_hid` shell command.
+ */
+void zmk_usb_hid_print_stats(void);
\ No newline at end of file
@@ -1 +1,9 @@
 struct k_work_q *zmk_workqueue_lowprio_work_q();
+
+/**
+ * Work queue for latency-critical input processing: kscan events, split peripheral events,
+ * behavior timers, queued behaviors and endpoint changes. Everything that touches keymap, HID or
+ * endpoint state runs here, so it never races with key processing. This is the system work queue
+ * unless a dedicated input queue is enabled.
+ */
+struct k_work_q *zmk_workqueue_input_work_q();
@@ -44,6 +44,18 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
     DT_INST_PROP_OR(n, debounce_period, DT_INST_PROP(n, debounce_release_ms))
 #endif
 
+#if CONFIG_ZMK_KSCAN_MATRIX_DEBOUNCE_SCAN_PERIOD_MS > 0
+#define INST_DEBOUNCE_SCAN_PERIOD_MS(n) CONFIG_ZMK_KSCAN_MATRIX_DEBOUNCE_SCAN_PERIOD_MS
+#else
+#define INST_DEBOUNCE_SCAN_PERIOD_MS(n) DT_INST_PROP(n, debounce_scan_period_ms)
+#endif
+
+#if CONFIG_ZMK_KSCAN_MATRIX_POLL_PERIOD_MS > 0
+#define INST_POLL_PERIOD_MS(n) CONFIG_ZMK_KSCAN_MATRIX_POLL_PERIOD_MS
+#else
+#define INST_POLL_PERIOD_MS(n) DT_INST_PROP(n, poll_period_ms)
+#endif
+
 #define USE_POLLING IS_ENABLED(CONFIG_ZMK_KSCAN_MATRIX_POLLING)
 #define USE_INTERRUPTS (!USE_POLLING)
 
@@ -460,8 +472,8 @@ static const struct kscan_driver_api kscan_matrix_api = {
                 .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(n),                                    \
                 .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(n),                                \
             },                                                                                     \
-        .debounce_scan_period_ms = DT_INST_PROP(n, debounce_scan_period_ms),                       \
-        .poll_period_ms = DT_INST_PROP(n, poll_period_ms),                                         \
+        .debounce_scan_period_ms = INST_DEBOUNCE_SCAN_PERIOD_MS(n),                                \
+        .poll_period_ms = INST_POLL_PERIOD_MS(n),                                                  \
         .diode_direction = INST_DIODE_DIR(n),                                                      \
     };                                                                                             \
                                                                                                    \
@@ -0,0 +1,118 @@
+# Copyright (c) 2023 The ZMK Contributors
+# SPDX-License-Identifier: MIT
+"""Generates constant key position sets from the devicetree.
+
+The C preprocessor can't emit one initializer per 32-bit word of a set of key positions, since
+the number of words is not a literal it can loop over. This script reads the devicetree that
+Zephyr already parsed and writes the sets out as initializers for the sources to use.
+"""
+
+import argparse
+import os
+import pickle
+import re
+import sys
+
+
+def str2ident(s):
+    # Same as Zephyr's gen_defines.py
+    return re.sub("[-,.@/+]", "_", s.lower())
+
+
+def node_id(node):
+    # The node identifier the devicetree macros expand to, e.g. DT_N_S_combos_S_combo_esc
+    components = ["DT_N"]
+    if node.parent is not None:
+        components.extend(f"S_{str2ident(c)}" for c in node.path.split("/")[1:])
+    return "_".join(components)
+
+
+def bitset_words(bits, words=None):
+    if words is None:
+        words = max(bits) // 32 + 1 if bits else 1
+    values = [0] * words
+    for bit in bits:
+        values[bit // 32] |= 1 << (bit % 32)
+    return "{" + ", ".join(f"0x{value:08x}" for value in values) + "}"
+
+
+def combo_lines(edt):
+    nodes = edt.compat2okay.get("zmk,combos", [])
+    if not nodes:
+        return []
+
+    combos = list(nodes[0].children.values())
+    keys = [combo.props["key-positions"].val for combo in combos]
+    # Shortest first, then in devicetree order. A combo's rank is its bit in a set of combos.
+    order = sorted(range(len(combos)), key=lambda index: (len(keys[index]), index))
+    rank = {index: r for r, index in enumerate(order)}
+    combo_words = (len(combos) + 31) // 32
+
+    lines = ["/* zmk,combos */"]
+    for index, combo in enumerate(combos):
+        lines.append(f"#define ZMK_COMBO_RANK_{node_id(combo)} {rank[index]}")
+        lines.append(f"#define ZMK_COMBO_KEY_MASK_{node_id(combo)} {bitset_words(keys[index])}")
+
+    by_position = {}
+    for index in range(len(combos)):
+        for position in keys[index]:
+            by_position.setdefault(position, set()).add(rank[index])
+    rows = [
+        f"[{position}] = {bitset_words(by_position[position], combo_words)}"
+        for position in sorted(by_position)
+    ]
+    lines.append("#define ZMK_COMBOS_BY_POSITION {" + ", ".join(rows) + "}")
+    return lines
+
+
+def hold_tap_lines(edt):
+    nodes = edt.compat2okay.get("zmk,behavior-hold-tap", [])
+    if not nodes:
+        return []
+
+    lines = ["/* zmk,behavior-hold-tap */"]
+    for node in nodes:
+        prop = node.props.get("hold-trigger-key-positions")
+        positions = prop.val if prop is not None else []
+        lines.append(
+            f"#define ZMK_HOLD_TAP_TRIGGER_MASK_{node_id(node)} {bitset_words(positions)}"
+        )
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--zephyr-base", required=True)
+    parser.add_argument("--edt-pickle", required=True)
+    parser.add_argument("--header-out", required=True)
+    args = parser.parse_args()
+
+    # The pickled EDT needs edtlib to load
+    sys.path.insert(
+        0, os.path.join(args.zephyr_base, "scripts", "dts", "python-devicetree", "src")
+    )
+    with open(args.edt_pickle, "rb") as f:
+        edt = pickle.load(f)
+
+    lines = [
+        "/* Generated by gen_position_sets.py from the devicetree, do not edit. */",
+        "",
+        "#pragma once",
+        "",
+    ]
+    lines += combo_lines(edt)
+    lines += hold_tap_lines(edt)
+
+    os.makedirs(os.path.dirname(args.header_out), exist_ok=True)
+    content = "\n".join(lines) + "\n"
+    # Leave the header alone if nothing changed, so sources including it aren't rebuilt
+    if os.path.exists(args.header_out):
+        with open(args.header_out) as f:
+            if f.read() == content:
+                return
+    with open(args.header_out, "w") as f:
+        f.write(content)
+
+
+if __name__ == "__main__":
+    main()
@@ -45,6 +45,11 @@ struct behavior_caps_word_data {
     bool active;
 };
 
+// The keycode listener is only enabled while at least one caps word instance is active.
+static int active_caps_word_count;
+
+const struct zmk_listener zmk_listener_behavior_caps_word;
+
 static void activate_caps_word(const struct device *dev) {
     struct behavior_caps_word_data *data = dev->data;
 
@@ -54,6 +59,9 @@ static void activate_caps_word(const struct device *dev) {
         zmk_keymap_layer_activate(config->layers, false);
     }
     data->active = true;
+    if (active_caps_word_count++ == 0) {
+        ZMK_LISTENER_ENABLE(behavior_caps_word);
+    }
 }
 
 static void deactivate_caps_word(const struct device *dev) {
@@ -65,11 +73,14 @@ static void deactivate_caps_word(const struct device *dev) {
         zmk_keymap_layer_deactivate(config->layers);
     }
     data->active = false;
+    if (--active_caps_word_count == 0) {
+        ZMK_LISTENER_DISABLE(behavior_caps_word);
+    }
 }
 
 static int on_caps_word_binding_pressed(struct zmk_behavior_binding *binding,
                                         struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     struct behavior_caps_word_data *data = dev->data;
 
     if (data->active) {
@@ -93,7 +104,7 @@ static const struct behavior_driver_api behavior_caps_word_driver_api = {
 
 static int caps_word_keycode_state_changed_listener(const zmk_event_t *eh);
 
-ZMK_LISTENER(behavior_caps_word, caps_word_keycode_state_changed_listener);
+ZMK_LISTENER_DISABLED(behavior_caps_word, caps_word_keycode_state_changed_listener);
 ZMK_SUBSCRIPTION(behavior_caps_word, zmk_keycode_state_changed);
 
 static const struct device *devs[DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)];
@@ -19,17 +19,24 @@
 #include <zmk/events/keycode_state_changed.h>
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
+#include <zmk/keystroke_timing.h>
+#include <zmk/timer.h>
+
+#include <zmk_position_sets.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
 #define ZMK_BHV_HOLD_TAP_MAX_HELD 10
-#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS 40
+#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS CONFIG_ZMK_HOLD_TAP_CAPTURE_QUEUE_SIZE
 
 // increase if you have keyboard with more keys.
 #define ZMK_BHV_HOLD_TAP_POSITION_NOT_USED 9999
 
+// hold-trigger-key-positions are kept as a bitset, one bit per key position
+#define ZMK_BHV_HOLD_TAP_POSITION_WORDS DIV_ROUND_UP(ZMK_KEYMAP_LEN, 32)
+
 enum flavor {
     FLAVOR_HOLD_PREFERRED,
     FLAVOR_BALANCED,
@@ -54,15 +61,15 @@ enum decision_moment {
 
 struct behavior_hold_tap_config {
     int tapping_term_ms;
-    char *hold_behavior_dev;
-    char *tap_behavior_dev;
+    struct zmk_behavior_binding hold_binding;
+    struct zmk_behavior_binding tap_binding;
     int quick_tap_ms;
     int require_prior_idle_ms;
     enum flavor flavor;
     bool retro_tap;
     bool hold_trigger_on_release;
     int32_t hold_trigger_key_positions_len;
-    int32_t hold_trigger_key_positions[];
+    uint32_t hold_trigger_key_position_mask[ZMK_BHV_HOLD_TAP_POSITION_WORDS];
 };
 
 // this data is specific for each hold-tap
@@ -73,8 +80,7 @@ struct active_hold_tap {
     int64_t timestamp;
     enum status status;
     const struct behavior_hold_tap_config *config;
-    struct k_work_delayable work;
-    bool work_is_cancelled;
+    struct zmk_timer timer;
 
     // initialized to -1, which is to be interpreted as "no other key has been pressed yet"
     int32_t position_of_first_other_key_pressed;
@@ -88,11 +94,25 @@ struct active_hold_tap {
 // its key-up has been processed and the delayed work is cleaned up.
 struct active_hold_tap *undecided_hold_tap = NULL;
 struct active_hold_tap active_hold_taps[ZMK_BHV_HOLD_TAP_MAX_HELD] = {};
+// Active hold-taps by key position. Hold-taps on virtual key positions, e.g. in combos, are
+// found by scanning active_hold_taps instead.
+static struct active_hold_tap *active_hold_tap_by_position[ZMK_KEYMAP_LEN];
+static int active_hold_tap_count;
 // We capture most position_state_changed events and some modifiers_state_changed events.
+// The captured events form a ring buffer indexed by free running sequence numbers. Events from
+// capture_head up to capture_tail belong to the undecided hold-tap; slots before capture_head
+// may still hold events that an outer release_captured_events call has yet to raise.
 const zmk_event_t *captured_events[ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS] = {};
+static uint32_t capture_head;
+static uint32_t capture_tail;
+// Sequence number of the last keydown captured for each position.
+static uint32_t captured_keydown_seq[ZMK_KEYMAP_LEN];
+
+#define CAPTURE_SLOT(seq) ((seq) % ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS)
 
-// Keep track of which key was tapped most recently for the standard, if it is a hold-tap
-// a position, will be given, if not it will just be INT32_MIN
+// Keep track of the hold-tap that was tapped most recently. Other key presses are tracked by the
+// keystroke timing service; once a key is pressed after the hold-tap it no longer counts as the
+// most recent tap.
 struct last_tapped {
     int32_t position;
     int64_t timestamp;
@@ -102,54 +122,62 @@ struct last_tapped {
 // int64 min since it will overflow if -1 is added
 struct last_tapped last_tapped = {INT32_MIN, INT32_MIN};
 
-static void store_last_tapped(int64_t timestamp) {
-    if (timestamp > last_tapped.timestamp) {
-        last_tapped.position = INT32_MIN;
-        last_tapped.timestamp = timestamp;
-    }
-}
-
 static void store_last_hold_tapped(struct active_hold_tap *hold_tap) {
     last_tapped.position = hold_tap->position;
     last_tapped.timestamp = hold_tap->timestamp;
 }
 
 static bool is_quick_tap(struct active_hold_tap *hold_tap) {
-    if ((last_tapped.timestamp + hold_tap->config->require_prior_idle_ms) > hold_tap->timestamp) {
+    int64_t last_tap = zmk_keystroke_timing_last_tap();
+    if (zmk_keystroke_timing_is_typing(hold_tap->timestamp,
+                                       hold_tap->config->require_prior_idle_ms) ||
+        (last_tapped.timestamp + hold_tap->config->require_prior_idle_ms) > hold_tap->timestamp) {
         return true;
     } else {
-        return (last_tapped.position == hold_tap->position) &&
+        return (last_tapped.position == hold_tap->position) && last_tap <= last_tapped.timestamp &&
                (last_tapped.timestamp + hold_tap->config->quick_tap_ms) > hold_tap->timestamp;
     }
 }
 
 static int capture_event(const zmk_event_t *event) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        if (captured_events[i] == NULL) {
-            captured_events[i] = event;
-            return 0;
-        }
+    // A slot is only cleared once its event has been raised again, so an occupied slot at the
+    // tail means the queue is full.
+    if (captured_events[CAPTURE_SLOT(capture_tail)] != NULL) {
+        return -ENOMEM;
+    }
+
+    struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(event);
+    if (position_event != NULL && position_event->state &&
+        position_event->position < ZMK_KEYMAP_LEN) {
+        captured_keydown_seq[position_event->position] = capture_tail;
     }
-    return -ENOMEM;
+
+    captured_events[CAPTURE_SLOT(capture_tail)] = event;
+    capture_tail++;
+    return 0;
 }
 
 static struct zmk_position_state_changed *find_captured_keydown_event(uint32_t position) {
-    struct zmk_position_state_changed *last_match = NULL;
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *eh = captured_events[i];
-        if (eh == NULL) {
-            return last_match;
-        }
-        struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(eh);
-        if (position_event == NULL) {
-            continue;
-        }
+    if (position >= ZMK_KEYMAP_LEN) {
+        return NULL;
+    }
 
-        if (position_event->position == position && position_event->state) {
-            last_match = position_event;
-        }
+    // Only events captured by the undecided hold-tap count, anything older is being released.
+    uint32_t seq = captured_keydown_seq[position];
+    if (seq - capture_head >= capture_tail - capture_head) {
+        return NULL;
     }
-    return last_match;
+
+    const zmk_event_t *eh = captured_events[CAPTURE_SLOT(seq)];
+    if (eh == NULL) {
+        return NULL;
+    }
+
+    struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(eh);
+    if (position_event == NULL || position_event->position != position || !position_event->state) {
+        return NULL;
+    }
+    return position_event;
 }
 
 const struct zmk_listener zmk_listener_behavior_hold_tap;
@@ -159,37 +187,29 @@ static void release_captured_events() {
         return;
     }
 
-    // We use a trick to prevent copying the captured_events array.
-    //
-    // Events for different mod-tap instances are separated by a NULL pointer.
-    //
-    // The first event popped will never be catched by the next active hold-tap
-    // because to start capturing a mod-tap-key-down event must first completely
-    // go through the events queue.
+    // The events captured so far are claimed by moving capture_head past them, so anything
+    // captured while they are raised again belongs to a new undecided hold-tap.
     //
     // Example of this release process;
-    // [mt2_down, k1_down, k1_up, mt2_up, null, ...]
-    //  ^
+    // [mt2_down, k1_down, k1_up, mt2_up] claimed, head and tail after mt2_up
     // mt2_down position event isn't captured because no hold-tap is active.
     // mt2_down behavior event is handled, now we have an undecided hold-tap
-    // [null, k1_down, k1_up, mt2_up, null, ...]
-    //        ^
-    // k1_down  is captured by the mt2 mod-tap
-    // !note that searches for find_captured_keydown_event by the mt2 behavior will stop at the
-    // first null encountered [mt1_down, null, k1_up, mt2_up, null, ...]
-    //                  ^
-    // k1_up event is captured by the new hold-tap:
-    // [k1_down, k1_up, null, mt2_up, null, ...]
-    //                        ^
+    // k1_down is raised and captured by the mt2 hold-tap at the tail:
+    // [null, null, k1_up, mt2_up, k1_down]
+    // k1_up event is captured by the mt2 hold-tap as well:
+    // [null, null, null, mt2_up, k1_down, k1_up]
     // mt2_up event is not captured but causes release of mt2 behavior
-    // [k1_down, k1_up, null, null, null, ...]
-    // now mt2 will start releasing it's own captured positions.
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *captured_event = captured_events[i];
+    // now mt2 will release the events from its own head, [k1_down, k1_up], before this loop
+    // continues with the remaining claimed events.
+    uint32_t start = capture_head;
+    uint32_t end = capture_tail;
+    capture_head = end;
+    for (uint32_t seq = start; seq != end; seq++) {
+        const zmk_event_t *captured_event = captured_events[CAPTURE_SLOT(seq)];
         if (captured_event == NULL) {
-            return;
+            continue;
         }
-        captured_events[i] = NULL;
+        captured_events[CAPTURE_SLOT(seq)] = NULL;
         if (undecided_hold_tap != NULL) {
             k_msleep(10);
         }
@@ -208,6 +228,9 @@ static void release_captured_events() {
 }
 
 static struct active_hold_tap *find_hold_tap(uint32_t position) {
+    if (position < ZMK_KEYMAP_LEN) {
+        return active_hold_tap_by_position[position];
+    }
     for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
         if (active_hold_taps[i].position == position) {
             return &active_hold_taps[i];
@@ -231,90 +254,55 @@ static struct active_hold_tap *store_hold_tap(uint32_t position, uint32_t param_
         active_hold_taps[i].timestamp = timestamp;
         active_hold_taps[i].position_of_first_other_key_pressed = -1;
         active_hold_taps[i].position_of_first_other_key_released = -1;
+        if (position < ZMK_KEYMAP_LEN) {
+            active_hold_tap_by_position[position] = &active_hold_taps[i];
+        }
+        active_hold_tap_count++;
         return &active_hold_taps[i];
     }
     return NULL;
 }
 
 static void clear_hold_tap(struct active_hold_tap *hold_tap) {
+    if (hold_tap->position < ZMK_KEYMAP_LEN) {
+        active_hold_tap_by_position[hold_tap->position] = NULL;
+    }
+    active_hold_tap_count--;
     hold_tap->position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
     hold_tap->status = STATUS_UNDECIDED;
-    hold_tap->work_is_cancelled = false;
 }
 
-static void decide_balanced(struct active_hold_tap *hold_tap, enum decision_moment event) {
-    switch (event) {
-    case HT_KEY_UP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    case HT_OTHER_KEY_UP:
-        hold_tap->status = STATUS_HOLD_INTERRUPT;
-        return;
-    case HT_TIMER_EVENT:
-        hold_tap->status = STATUS_HOLD_TIMER;
-        return;
-    case HT_QUICK_TAP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    default:
-        return;
-    }
-}
-
-static void decide_tap_preferred(struct active_hold_tap *hold_tap, enum decision_moment event) {
-    switch (event) {
-    case HT_KEY_UP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    case HT_TIMER_EVENT:
-        hold_tap->status = STATUS_HOLD_TIMER;
-        return;
-    case HT_QUICK_TAP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    default:
-        return;
-    }
-}
-
-static void decide_tap_unless_interrupted(struct active_hold_tap *hold_tap,
-                                          enum decision_moment event) {
-    switch (event) {
-    case HT_KEY_UP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    case HT_OTHER_KEY_DOWN:
-        hold_tap->status = STATUS_HOLD_INTERRUPT;
-        return;
-    case HT_TIMER_EVENT:
-        hold_tap->status = STATUS_TAP;
-        return;
-    case HT_QUICK_TAP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    default:
-        return;
-    }
-}
-
-static void decide_hold_preferred(struct active_hold_tap *hold_tap, enum decision_moment event) {
-    switch (event) {
-    case HT_KEY_UP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    case HT_OTHER_KEY_DOWN:
-        hold_tap->status = STATUS_HOLD_INTERRUPT;
-        return;
-    case HT_TIMER_EVENT:
-        hold_tap->status = STATUS_HOLD_TIMER;
-        return;
-    case HT_QUICK_TAP:
-        hold_tap->status = STATUS_TAP;
-        return;
-    default:
-        return;
-    }
-}
+// The decision each flavor makes at each decision moment. Moments a flavor ignores are left
+// STATUS_UNDECIDED.
+static const enum status flavor_decisions[][HT_QUICK_TAP + 1] = {
+    [FLAVOR_HOLD_PREFERRED] =
+        {
+            [HT_KEY_UP] = STATUS_TAP,
+            [HT_OTHER_KEY_DOWN] = STATUS_HOLD_INTERRUPT,
+            [HT_TIMER_EVENT] = STATUS_HOLD_TIMER,
+            [HT_QUICK_TAP] = STATUS_TAP,
+        },
+    [FLAVOR_BALANCED] =
+        {
+            [HT_KEY_UP] = STATUS_TAP,
+            [HT_OTHER_KEY_UP] = STATUS_HOLD_INTERRUPT,
+            [HT_TIMER_EVENT] = STATUS_HOLD_TIMER,
+            [HT_QUICK_TAP] = STATUS_TAP,
+        },
+    [FLAVOR_TAP_PREFERRED] =
+        {
+            [HT_KEY_UP] = STATUS_TAP,
+            [HT_TIMER_EVENT] = STATUS_HOLD_TIMER,
+            [HT_QUICK_TAP] = STATUS_TAP,
+        },
+    [FLAVOR_TAP_UNLESS_INTERRUPTED] =
+        {
+            [HT_KEY_UP] = STATUS_TAP,
+            [HT_OTHER_KEY_DOWN] = STATUS_HOLD_INTERRUPT,
+            [HT_TIMER_EVENT] = STATUS_TAP,
+            [HT_QUICK_TAP] = STATUS_TAP,
+        },
+};
 
 static inline const char *flavor_str(enum flavor flavor) {
     switch (flavor) {
@@ -373,12 +361,12 @@ static int press_binding(struct active_hold_tap *hold_tap) {
         .timestamp = hold_tap->timestamp,
     };
 
-    struct zmk_behavior_binding binding = {0};
+    struct zmk_behavior_binding binding;
     if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
+        binding = hold_tap->config->hold_binding;
         binding.param1 = hold_tap->param_hold;
     } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
+        binding = hold_tap->config->tap_binding;
         binding.param1 = hold_tap->param_tap;
         store_last_hold_tapped(hold_tap);
     }
@@ -395,38 +383,24 @@ static int release_binding(struct active_hold_tap *hold_tap) {
         .timestamp = hold_tap->timestamp,
     };
 
-    struct zmk_behavior_binding binding = {0};
+    struct zmk_behavior_binding binding;
     if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
+        binding = hold_tap->config->hold_binding;
         binding.param1 = hold_tap->param_hold;
     } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
+        binding = hold_tap->config->tap_binding;
         binding.param1 = hold_tap->param_tap;
     }
     return behavior_keymap_binding_released(&binding, event);
 }
 
-static bool is_first_other_key_pressed_trigger_key(struct active_hold_tap *hold_tap) {
-    for (int i = 0; i < hold_tap->config->hold_trigger_key_positions_len; i++) {
-        if (hold_tap->config->hold_trigger_key_positions[i] ==
-            hold_tap->position_of_first_other_key_pressed) {
-            return true;
-        }
-    }
-    return false;
-}
-
-static bool is_first_other_key_released_trigger_key(struct active_hold_tap *hold_tap) {
-    for (int i = 0; i < hold_tap->config->hold_trigger_key_positions_len; i++) {
-        if (hold_tap->config->hold_trigger_key_positions[i] ==
-            hold_tap->position_of_first_other_key_released) {
-            return true;
-        }
+static bool is_trigger_key(struct active_hold_tap *hold_tap, int32_t position) {
+    if (position < 0 || position >= ZMK_KEYMAP_LEN) {
+        return false;
     }
-    return false;
+    return hold_tap->config->hold_trigger_key_position_mask[position / 32] & BIT(position % 32);
 }
 
-
 static void decide_positional_hold(struct active_hold_tap *hold_tap) {
     
     // Positional conditions is not active?
@@ -440,7 +414,7 @@ static void decide_positional_hold(struct active_hold_tap *hold_tap) {
     }
     
     // Pressed key is included in positions? 
-    if (is_first_other_key_pressed_trigger_key(hold_tap)) {
+    if (is_trigger_key(hold_tap, hold_tap->position_of_first_other_key_pressed)) {
         return; // apply flavor
     }
 
@@ -476,7 +450,7 @@ static void decide_positional_hold(struct active_hold_tap *hold_tap) {
 
 
     // Released key is included in positions?
-    if (is_first_other_key_released_trigger_key(hold_tap)) {
+    if (is_trigger_key(hold_tap, hold_tap->position_of_first_other_key_released)) {
         return; // apply flavor
     } 
     
@@ -497,20 +471,7 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
     }
 
     // If the hold-tap behavior is still undecided, attempt to decide it.
-    switch (hold_tap->config->flavor) {
-    case FLAVOR_HOLD_PREFERRED:
-        decide_hold_preferred(hold_tap, decision_moment);
-        break;
-    case FLAVOR_BALANCED:
-        decide_balanced(hold_tap, decision_moment);
-        break;
-    case FLAVOR_TAP_PREFERRED:
-        decide_tap_preferred(hold_tap, decision_moment);
-        break;
-    case FLAVOR_TAP_UNLESS_INTERRUPTED:
-        decide_tap_unless_interrupted(hold_tap, decision_moment);
-        break;
-    }
+    hold_tap->status = flavor_decisions[hold_tap->config->flavor][decision_moment];
 
     if (hold_tap->status == STATUS_UNDECIDED) {
         return;
@@ -545,6 +506,10 @@ static void decide_retro_tap(struct active_hold_tap *hold_tap) {
 }
 
 static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
+    if (active_hold_tap_count == 0) {
+        return;
+    }
+
     for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
         struct active_hold_tap *hold_tap = &active_hold_taps[i];
         if (hold_tap->position == ignore_position ||
@@ -562,7 +527,7 @@ static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
 
 static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
                                        struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_hold_tap_config *cfg = dev->config;
 
     if (undecided_hold_tap != NULL) {
@@ -586,10 +551,9 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
         decide_hold_tap(hold_tap, HT_QUICK_TAP);
     }
 
-    // if this behavior was queued we have to adjust the timer to only
-    // wait for the remaining time.
-    int32_t tapping_term_ms_left = (hold_tap->timestamp + cfg->tapping_term_ms) - k_uptime_get();
-    k_work_schedule(&hold_tap->work, K_MSEC(tapping_term_ms_left));
+    // if this behavior was queued, the deadline is relative to the original key press so the
+    // timer only waits for the remaining time.
+    zmk_timer_start(&hold_tap->timer, hold_tap->timestamp + cfg->tapping_term_ms);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -604,7 +568,7 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
 
     // If these events were queued, the timer event may be queued too late or not at all.
     // We insert a timer event before the TH_KEY_UP event to verify.
-    int work_cancel_result = k_work_cancel_delayable(&hold_tap->work);
+    zmk_timer_stop(&hold_tap->timer);
     if (event.timestamp > (hold_tap->timestamp + hold_tap->config->tapping_term_ms)) {
         decide_hold_tap(hold_tap, HT_TIMER_EVENT);
     }
@@ -613,15 +577,8 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
     decide_retro_tap(hold_tap);
     release_binding(hold_tap);
 
-    if (work_cancel_result == -EINPROGRESS) {
-        // let the timer handler clean up
-        // if we'd clear now, the timer may call back for an uninitialized active_hold_tap.
-        LOG_DBG("%d hold-tap timer work in event queue", event.position);
-        hold_tap->work_is_cancelled = true;
-    } else {
-        LOG_DBG("%d cleaning up hold-tap", event.position);
-        clear_hold_tap(hold_tap);
-    }
+    LOG_DBG("%d cleaning up hold-tap", event.position);
+    clear_hold_tap(hold_tap);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -631,6 +588,30 @@ static const struct behavior_driver_api behavior_hold_tap_driver_api = {
     .binding_released = on_hold_tap_binding_released,
 };
 
+// Capture an event for the undecided hold-tap. If the capture queue is full, the hold-tap is
+// decided as if its tapping term expired so the queue drains instead of losing the event.
+static int capture_or_decide(const zmk_event_t *eh) {
+    if (capture_event(eh) == 0) {
+        return ZMK_EV_EVENT_CAPTURED;
+    }
+
+    LOG_WRN("%d capture queue full (%d events), deciding hold-tap early",
+            undecided_hold_tap->position, ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS);
+    decide_hold_tap(undecided_hold_tap, HT_TIMER_EVENT);
+
+    if (undecided_hold_tap == NULL) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (capture_event(eh) == 0) {
+        return ZMK_EV_EVENT_CAPTURED;
+    }
+
+    LOG_ERR("%d unable to capture event, raising it ahead of the captured events",
+            undecided_hold_tap->position);
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
 static int position_state_changed_listener(const zmk_event_t *eh) {
     struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
 
@@ -684,7 +665,9 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
 
     LOG_DBG("%d capturing %d %s event", undecided_hold_tap->position, ev->position,
             ev->state ? "down" : "up");
-    capture_event(eh);
+    if (capture_or_decide(eh) != ZMK_EV_EVENT_CAPTURED) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     decide_hold_tap(undecided_hold_tap, ev->state ? HT_OTHER_KEY_DOWN : HT_OTHER_KEY_UP);
     return ZMK_EV_EVENT_CAPTURED;
 }
@@ -693,10 +676,6 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
     // we want to catch layer-up events too... how?
     struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
 
-    if (ev->state && !is_mod(ev->usage_page, ev->keycode)) {
-        store_last_tapped(ev->timestamp);
-    }
-
     if (undecided_hold_tap == NULL) {
         // LOG_DBG("0x%02X bubble (no undecided hold_tap active)", ev->keycode);
         return ZMK_EV_EVENT_BUBBLE;
@@ -711,8 +690,7 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
     // if a undecided_hold_tap is active.
     LOG_DBG("%d capturing 0x%02X %s event", undecided_hold_tap->position, ev->keycode,
             ev->state ? "down" : "up");
-    capture_event(eh);
-    return ZMK_EV_EVENT_CAPTURED;
+    return capture_or_decide(eh);
 }
 
 int behavior_hold_tap_listener(const zmk_event_t *eh) {
@@ -729,14 +707,10 @@ ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_position_state_changed);
 // this should be modifiers_state_changed, but unfrotunately that's not implemented yet.
 ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_keycode_state_changed);
 
-void behavior_hold_tap_timer_work_handler(struct k_work *item) {
-    struct active_hold_tap *hold_tap = CONTAINER_OF(item, struct active_hold_tap, work);
+void behavior_hold_tap_timer_handler(struct zmk_timer *timer) {
+    struct active_hold_tap *hold_tap = CONTAINER_OF(timer, struct active_hold_tap, timer);
 
-    if (hold_tap->work_is_cancelled) {
-        clear_hold_tap(hold_tap);
-    } else {
-        decide_hold_tap(hold_tap, HT_TIMER_EVENT);
-    }
+    decide_hold_tap(hold_tap, HT_TIMER_EVENT);
 }
 
 static int behavior_hold_tap_init(const struct device *dev) {
@@ -744,7 +718,7 @@ static int behavior_hold_tap_init(const struct device *dev) {
 
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-            k_work_init_delayable(&active_hold_taps[i].work, behavior_hold_tap_timer_work_handler);
+            zmk_timer_init(&active_hold_taps[i].timer, behavior_hold_tap_timer_handler);
             active_hold_taps[i].position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
         }
     }
@@ -752,11 +726,22 @@ static int behavior_hold_tap_init(const struct device *dev) {
     return 0;
 }
 
+#define HT_TRIGGER_KEY(node, i) DT_PROP_BY_IDX(node, hold_trigger_key_positions, i)
+
+// The trigger position mask is generated from the devicetree by scripts/gen_position_sets.py, one
+// initializer per word.
+#define HT_TRIGGER_MASK(node) UTIL_CAT(ZMK_HOLD_TAP_TRIGGER_MASK_, node)
+
+#define HT_TRIGGER_POSITION_VALID(node, prop, i) &&(HT_TRIGGER_KEY(node, i) < ZMK_KEYMAP_LEN)
+
 #define KP_INST(n)                                                                                 \
+    BUILD_ASSERT(1 DT_INST_FOREACH_PROP_ELEM(n, hold_trigger_key_positions,                        \
+                                             HT_TRIGGER_POSITION_VALID),                           \
+                 "hold-trigger-key-positions has a position that does not exist in the keymap");   \
     static struct behavior_hold_tap_config behavior_hold_tap_config_##n = {                        \
         .tapping_term_ms = DT_INST_PROP(n, tapping_term_ms),                                       \
-        .hold_behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 0), label),               \
-        .tap_behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 1), label),                \
+        .hold_binding = {.behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 0), label)},  \
+        .tap_binding = {.behavior_dev = DT_PROP(DT_INST_PHANDLE_BY_IDX(n, bindings, 1), label)},   \
         .quick_tap_ms = DT_INST_PROP(n, quick_tap_ms),                                             \
         .require_prior_idle_ms = DT_INST_PROP(n, global_quick_tap)                                 \
                                      ? DT_INST_PROP(n, quick_tap_ms)                               \
@@ -764,7 +749,7 @@ static int behavior_hold_tap_init(const struct device *dev) {
         .flavor = DT_ENUM_IDX(DT_DRV_INST(n), flavor),                                             \
         .retro_tap = DT_INST_PROP(n, retro_tap),                                                   \
         .hold_trigger_on_release = DT_INST_PROP(n, hold_trigger_on_release),                       \
-        .hold_trigger_key_positions = DT_INST_PROP(n, hold_trigger_key_positions),                 \
+        .hold_trigger_key_position_mask = HT_TRIGGER_MASK(DT_DRV_INST(n)),                         \
         .hold_trigger_key_positions_len = DT_INST_PROP_LEN(n, hold_trigger_key_positions),         \
     };                                                                                             \
     DEVICE_DT_INST_DEFINE(n, behavior_hold_tap_init, NULL, NULL, &behavior_hold_tap_config_##n,    \
@@ -773,4 +758,16 @@ static int behavior_hold_tap_init(const struct device *dev) {
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
+#define RESOLVE_INST(n)                                                                            \
+    zmk_behavior_binding_get_device(&behavior_hold_tap_config_##n.hold_binding);                   \
+    zmk_behavior_binding_get_device(&behavior_hold_tap_config_##n.tap_binding);
+
+// Resolve the hold and tap behavior devices once all behaviors are ready
+static int behavior_hold_tap_resolve_bindings(const struct device *_arg) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST);
+    return 0;
+}
+
+SYS_INIT(behavior_hold_tap_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif /* DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT) */
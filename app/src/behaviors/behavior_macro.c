@@ -5,6 +5,7 @@
  */
 
 #include <zephyr/device.h>
+#include <zephyr/init.h>
 #include <drivers/behavior.h>
 #include <zephyr/logging/log.h>
 #include <zmk/behavior.h>
@@ -21,6 +22,22 @@ enum behavior_macro_mode {
 
 enum param_source { PARAM_SOURCE_BINDING, PARAM_SOURCE_MACRO_1ST, PARAM_SOURCE_MACRO_2ND };
 
+// Each macro binding is compiled to one of these at init, so running a macro never has to compare
+// behavior names.
+enum behavior_macro_op {
+    MACRO_OP_INVOKE,
+    MACRO_OP_MODE_TAP,
+    MACRO_OP_MODE_PRESS,
+    MACRO_OP_MODE_RELEASE,
+    MACRO_OP_TAP_TIME,
+    MACRO_OP_WAIT_TIME,
+    MACRO_OP_PAUSE,
+    MACRO_OP_P1TO1,
+    MACRO_OP_P1TO2,
+    MACRO_OP_P2TO1,
+    MACRO_OP_P2TO2,
+};
+
 struct behavior_macro_trigger_state {
     uint32_t wait_ms;
     uint32_t tap_ms;
@@ -41,6 +58,7 @@ struct behavior_macro_config {
     uint32_t default_wait_ms;
     uint32_t default_tap_ms;
     uint32_t count;
+    uint8_t *ops;
     struct zmk_behavior_binding bindings[];
 };
 
@@ -71,36 +89,72 @@ struct behavior_macro_config {
 #define IS_P2TO1(dev) ZM_IS_NODE_MATCH(dev, P2TO1)
 #define IS_P2TO2(dev) ZM_IS_NODE_MATCH(dev, P2TO2)
 
-static bool handle_control_binding(struct behavior_macro_trigger_state *state,
-                                   const struct zmk_behavior_binding *binding) {
+static enum behavior_macro_op compile_binding(const struct zmk_behavior_binding *binding) {
     if (IS_TAP_MODE(binding->behavior_dev)) {
+        return MACRO_OP_MODE_TAP;
+    } else if (IS_PRESS_MODE(binding->behavior_dev)) {
+        return MACRO_OP_MODE_PRESS;
+    } else if (IS_RELEASE_MODE(binding->behavior_dev)) {
+        return MACRO_OP_MODE_RELEASE;
+    } else if (IS_TAP_TIME(binding->behavior_dev)) {
+        return MACRO_OP_TAP_TIME;
+    } else if (IS_WAIT_TIME(binding->behavior_dev)) {
+        return MACRO_OP_WAIT_TIME;
+    } else if (IS_PAUSE(binding->behavior_dev)) {
+        return MACRO_OP_PAUSE;
+    } else if (IS_P1TO1(binding->behavior_dev)) {
+        return MACRO_OP_P1TO1;
+    } else if (IS_P1TO2(binding->behavior_dev)) {
+        return MACRO_OP_P1TO2;
+    } else if (IS_P2TO1(binding->behavior_dev)) {
+        return MACRO_OP_P2TO1;
+    } else if (IS_P2TO2(binding->behavior_dev)) {
+        return MACRO_OP_P2TO2;
+    }
+
+    return MACRO_OP_INVOKE;
+}
+
+static bool handle_control_op(struct behavior_macro_trigger_state *state, uint8_t op,
+                              const struct zmk_behavior_binding *binding) {
+    switch (op) {
+    case MACRO_OP_MODE_TAP:
         state->mode = MACRO_MODE_TAP;
         LOG_DBG("macro mode set: tap");
-    } else if (IS_PRESS_MODE(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_MODE_PRESS:
         state->mode = MACRO_MODE_PRESS;
         LOG_DBG("macro mode set: press");
-    } else if (IS_RELEASE_MODE(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_MODE_RELEASE:
         state->mode = MACRO_MODE_RELEASE;
         LOG_DBG("macro mode set: release");
-    } else if (IS_TAP_TIME(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_TAP_TIME:
         state->tap_ms = binding->param1;
         LOG_DBG("macro tap time set: %d", state->tap_ms);
-    } else if (IS_WAIT_TIME(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_WAIT_TIME:
         state->wait_ms = binding->param1;
         LOG_DBG("macro wait time set: %d", state->wait_ms);
-    } else if (IS_P1TO1(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_P1TO1:
         state->param1_source = PARAM_SOURCE_MACRO_1ST;
         LOG_DBG("macro param: 1to1");
-    } else if (IS_P1TO2(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_P1TO2:
         state->param2_source = PARAM_SOURCE_MACRO_1ST;
         LOG_DBG("macro param: 1to2");
-    } else if (IS_P2TO1(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_P2TO1:
         state->param1_source = PARAM_SOURCE_MACRO_2ND;
         LOG_DBG("macro param: 2to1");
-    } else if (IS_P2TO2(binding->behavior_dev)) {
+        break;
+    case MACRO_OP_P2TO2:
         state->param2_source = PARAM_SOURCE_MACRO_2ND;
         LOG_DBG("macro param: 2to2");
-    } else {
+        break;
+    default:
         return false;
     }
 
@@ -114,11 +168,15 @@ static int behavior_macro_init(const struct device *dev) {
     state->release_state.start_index = cfg->count;
     state->release_state.count = 0;
 
+    for (int i = 0; i < cfg->count; i++) {
+        cfg->ops[i] = compile_binding(&cfg->bindings[i]);
+    }
+
     LOG_DBG("Precalculate initial release state:");
     for (int i = 0; i < cfg->count; i++) {
-        if (handle_control_binding(&state->release_state, &cfg->bindings[i])) {
+        if (handle_control_op(&state->release_state, cfg->ops[i], &cfg->bindings[i])) {
             // Updated state used for initial state on release.
-        } else if (IS_PAUSE(cfg->bindings[i].behavior_dev)) {
+        } else if (cfg->ops[i] == MACRO_OP_PAUSE) {
             state->release_state.start_index = i + 1;
             state->release_state.count = cfg->count - state->release_state.start_index;
             state->press_bindings_count = i;
@@ -154,13 +212,13 @@ static void replace_params(struct behavior_macro_trigger_state *state,
     state->param2_source = PARAM_SOURCE_BINDING;
 }
 
-static void queue_macro(uint32_t position, const struct zmk_behavior_binding bindings[],
+static void queue_macro(uint32_t position, const struct behavior_macro_config *cfg,
                         struct behavior_macro_trigger_state state,
                         const struct zmk_behavior_binding *macro_binding) {
     LOG_DBG("Iterating macro bindings - starting: %d, count: %d", state.start_index, state.count);
     for (int i = state.start_index; i < state.start_index + state.count; i++) {
-        if (!handle_control_binding(&state, &bindings[i])) {
-            struct zmk_behavior_binding binding = bindings[i];
+        if (cfg->ops[i] == MACRO_OP_INVOKE) {
+            struct zmk_behavior_binding binding = cfg->bindings[i];
             replace_params(&state, &binding, macro_binding);
 
             switch (state.mode) {
@@ -178,13 +236,15 @@ static void queue_macro(uint32_t position, const struct zmk_behavior_binding bin
                 LOG_ERR("Unknown macro mode: %d", state.mode);
                 break;
             }
+        } else {
+            handle_control_op(&state, cfg->ops[i], &cfg->bindings[i]);
         }
     }
 }
 
 static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                     struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
     struct behavior_macro_trigger_state trigger_state = {.mode = MACRO_MODE_TAP,
@@ -193,18 +253,18 @@ static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                                          .start_index = 0,
                                                          .count = state->press_bindings_count};
 
-    queue_macro(event.position, cfg->bindings, trigger_state, binding);
+    queue_macro(event.position, cfg, trigger_state, binding);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
 
 static int on_macro_binding_released(struct zmk_behavior_binding *binding,
                                      struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
 
-    queue_macro(event.position, cfg->bindings, state->release_state, binding);
+    queue_macro(event.position, cfg, state->release_state, binding);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -219,10 +279,12 @@ static const struct behavior_driver_api behavior_macro_driver_api = {
 
 #define MACRO_INST(inst)                                                                           \
     static struct behavior_macro_state behavior_macro_state_##inst = {};                           \
+    static uint8_t behavior_macro_ops_##inst[DT_PROP_LEN(inst, bindings)];                         \
     static struct behavior_macro_config behavior_macro_config_##inst = {                           \
         .default_wait_ms = DT_PROP_OR(inst, wait_ms, CONFIG_ZMK_MACRO_DEFAULT_WAIT_MS),            \
         .default_tap_ms = DT_PROP_OR(inst, tap_ms, CONFIG_ZMK_MACRO_DEFAULT_TAP_MS),               \
         .count = DT_PROP_LEN(inst, bindings),                                                      \
+        .ops = behavior_macro_ops_##inst,                                                          \
         .bindings = TRANSFORMED_BEHAVIORS(inst)};                                                  \
     DEVICE_DT_DEFINE(inst, behavior_macro_init, NULL, &behavior_macro_state_##inst,                \
                      &behavior_macro_config_##inst, APPLICATION,                                   \
@@ -231,3 +293,23 @@ static const struct behavior_driver_api behavior_macro_driver_api = {
 DT_FOREACH_STATUS_OKAY(zmk_behavior_macro, MACRO_INST)
 DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_one_param, MACRO_INST)
 DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_two_param, MACRO_INST)
+
+static void resolve_macro_bindings(struct behavior_macro_config *cfg) {
+    for (int i = 0; i < cfg->count; i++) {
+        if (cfg->ops[i] == MACRO_OP_INVOKE) {
+            zmk_behavior_binding_get_device(&cfg->bindings[i]);
+        }
+    }
+}
+
+#define RESOLVE_INST(inst) resolve_macro_bindings(&behavior_macro_config_##inst);
+
+// Resolve the devices of the invoked behaviors once all behaviors are ready
+static int behavior_macro_resolve_bindings(const struct device *_arg) {
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_macro, RESOLVE_INST)
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_one_param, RESOLVE_INST)
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_two_param, RESOLVE_INST)
+    return 0;
+}
+
+SYS_INIT(behavior_macro_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
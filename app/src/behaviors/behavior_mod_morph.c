@@ -36,7 +36,7 @@ struct behavior_mod_morph_data {
 
 static int on_mod_morph_binding_pressed(struct zmk_behavior_binding *binding,
                                         struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_mod_morph_config *cfg = dev->config;
     struct behavior_mod_morph_data *data = dev->data;
 
@@ -56,7 +56,7 @@ static int on_mod_morph_binding_pressed(struct zmk_behavior_binding *binding,
 
 static int on_mod_morph_binding_released(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     struct behavior_mod_morph_data *data = dev->data;
 
     if (data->pressed_binding == NULL) {
@@ -103,4 +103,16 @@ static int behavior_mod_morph_init(const struct device *dev) { return 0; }
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
+#define RESOLVE_INST(n)                                                                            \
+    zmk_behavior_binding_get_device(&behavior_mod_morph_config_##n.normal_binding);                \
+    zmk_behavior_binding_get_device(&behavior_mod_morph_config_##n.morph_binding);
+
+// Resolve the normal and morph behavior devices once all behaviors are ready
+static int behavior_mod_morph_resolve_bindings(const struct device *_arg) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST);
+    return 0;
+}
+
+SYS_INIT(behavior_mod_morph_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif
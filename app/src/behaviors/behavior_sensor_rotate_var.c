@@ -32,3 +32,16 @@ static int behavior_sensor_rotate_var_init(const struct device *dev) { return 0;
         &behavior_sensor_rotate_var_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(SENSOR_ROTATE_VAR_INST)
+
+#define RESOLVE_INST(n)                                                                            \
+    zmk_behavior_binding_get_device(&behavior_sensor_rotate_var_config_##n.cw_binding);            \
+    zmk_behavior_binding_get_device(&behavior_sensor_rotate_var_config_##n.ccw_binding);
+
+// Resolve the clockwise and counter-clockwise behavior devices once all behaviors are ready
+static int behavior_sensor_rotate_var_resolve_bindings(const struct device *_arg) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST);
+    return 0;
+}
+
+SYS_INIT(behavior_sensor_rotate_var_resolve_bindings, APPLICATION,
+         CONFIG_APPLICATION_INIT_PRIORITY);
@@ -19,6 +19,7 @@
 #include <zmk/events/modifiers_state_changed.h>
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
+#include <zmk/timer.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -42,23 +43,31 @@ struct active_sticky_key {
     const struct behavior_sticky_key_config *config;
     // timer data.
     bool timer_started;
-    bool timer_cancelled;
     int64_t release_at;
-    struct k_work_delayable release_timer;
+    struct zmk_timer release_timer;
     // usage page and keycode for the key that is being modified by this sticky key
     uint8_t modified_key_usage_page;
     uint32_t modified_key_keycode;
 };
 
 struct active_sticky_key active_sticky_keys[ZMK_BHV_STICKY_KEY_MAX_HELD] = {};
+// Active sticky keys by key position. Sticky keys on virtual key positions, e.g. in combos, are
+// found by scanning active_sticky_keys instead.
+static struct active_sticky_key *active_sticky_key_by_position[ZMK_KEYMAP_LEN];
+static int active_sticky_key_count;
+
+// The keycode listener is only enabled while there are active sticky keys.
+const struct zmk_listener zmk_listener_behavior_sticky_key;
+
+// Key presses from the key press behavior of a sticky key itself are not reacted to.
+static const struct device *key_press_behavior;
 
 static struct active_sticky_key *store_sticky_key(uint32_t position, uint32_t param1,
                                                   uint32_t param2,
                                                   const struct behavior_sticky_key_config *config) {
     for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
         struct active_sticky_key *const sticky_key = &active_sticky_keys[i];
-        if (sticky_key->position != ZMK_BHV_STICKY_KEY_POSITION_FREE ||
-            sticky_key->timer_cancelled) {
+        if (sticky_key->position != ZMK_BHV_STICKY_KEY_POSITION_FREE) {
             continue;
         }
         sticky_key->position = position;
@@ -66,22 +75,36 @@ static struct active_sticky_key *store_sticky_key(uint32_t position, uint32_t pa
         sticky_key->param2 = param2;
         sticky_key->config = config;
         sticky_key->release_at = 0;
-        sticky_key->timer_cancelled = false;
         sticky_key->timer_started = false;
         sticky_key->modified_key_usage_page = 0;
         sticky_key->modified_key_keycode = 0;
+        if (position < ZMK_KEYMAP_LEN) {
+            active_sticky_key_by_position[position] = sticky_key;
+        }
+        if (active_sticky_key_count++ == 0) {
+            ZMK_LISTENER_ENABLE(behavior_sticky_key);
+        }
         return sticky_key;
     }
     return NULL;
 }
 
 static void clear_sticky_key(struct active_sticky_key *sticky_key) {
+    if (sticky_key->position < ZMK_KEYMAP_LEN) {
+        active_sticky_key_by_position[sticky_key->position] = NULL;
+    }
+    if (--active_sticky_key_count == 0) {
+        ZMK_LISTENER_DISABLE(behavior_sticky_key);
+    }
     sticky_key->position = ZMK_BHV_STICKY_KEY_POSITION_FREE;
 }
 
 static struct active_sticky_key *find_sticky_key(uint32_t position) {
+    if (position < ZMK_KEYMAP_LEN) {
+        return active_sticky_key_by_position[position];
+    }
     for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-        if (active_sticky_keys[i].position == position && !active_sticky_keys[i].timer_cancelled) {
+        if (active_sticky_keys[i].position == position) {
             return &active_sticky_keys[i];
         }
     }
@@ -90,11 +113,9 @@ static struct active_sticky_key *find_sticky_key(uint32_t position) {
 
 static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key,
                                             int64_t timestamp) {
-    struct zmk_behavior_binding binding = {
-        .behavior_dev = sticky_key->config->behavior.behavior_dev,
-        .param1 = sticky_key->param1,
-        .param2 = sticky_key->param2,
-    };
+    struct zmk_behavior_binding binding = sticky_key->config->behavior;
+    binding.param1 = sticky_key->param1;
+    binding.param2 = sticky_key->param2;
     struct zmk_behavior_binding_event event = {
         .position = sticky_key->position,
         .timestamp = timestamp,
@@ -104,11 +125,9 @@ static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key
 
 static inline int release_sticky_key_behavior(struct active_sticky_key *sticky_key,
                                               int64_t timestamp) {
-    struct zmk_behavior_binding binding = {
-        .behavior_dev = sticky_key->config->behavior.behavior_dev,
-        .param1 = sticky_key->param1,
-        .param2 = sticky_key->param2,
-    };
+    struct zmk_behavior_binding binding = sticky_key->config->behavior;
+    binding.param1 = sticky_key->param1;
+    binding.param2 = sticky_key->param2;
     struct zmk_behavior_binding_event event = {
         .position = sticky_key->position,
         .timestamp = timestamp,
@@ -118,18 +137,13 @@ static inline int release_sticky_key_behavior(struct active_sticky_key *sticky_k
     return behavior_keymap_binding_released(&binding, event);
 }
 
-static int stop_timer(struct active_sticky_key *sticky_key) {
-    int timer_cancel_result = k_work_cancel_delayable(&sticky_key->release_timer);
-    if (timer_cancel_result == -EINPROGRESS) {
-        // too late to cancel, we'll let the timer handler clear up.
-        sticky_key->timer_cancelled = true;
-    }
-    return timer_cancel_result;
+static void stop_timer(struct active_sticky_key *sticky_key) {
+    zmk_timer_stop(&sticky_key->release_timer);
 }
 
 static int on_sticky_key_binding_pressed(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_sticky_key_config *cfg = dev->config;
     struct active_sticky_key *sticky_key;
     sticky_key = find_sticky_key(event.position);
@@ -166,9 +180,8 @@ static int on_sticky_key_binding_released(struct zmk_behavior_binding *binding,
     sticky_key->timer_started = true;
     sticky_key->release_at = event.timestamp + sticky_key->config->release_after_ms;
     // adjust timer in case this behavior was queued by a hold-tap
-    int32_t ms_left = sticky_key->release_at - k_uptime_get();
-    if (ms_left > 0) {
-        k_work_schedule(&sticky_key->release_timer, K_MSEC(ms_left));
+    if (sticky_key->release_at > k_uptime_get()) {
+        zmk_timer_start(&sticky_key->release_timer, sticky_key->release_at);
     }
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -180,7 +193,7 @@ static const struct behavior_driver_api behavior_sticky_key_driver_api = {
 
 static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh);
 
-ZMK_LISTENER(behavior_sticky_key, sticky_key_keycode_state_changed_listener);
+ZMK_LISTENER_DISABLED(behavior_sticky_key, sticky_key_keycode_state_changed_listener);
 ZMK_SUBSCRIPTION(behavior_sticky_key, zmk_keycode_state_changed);
 
 static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
@@ -202,7 +215,7 @@ static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
             continue;
         }
 
-        if (strcmp(sticky_key->config->behavior.behavior_dev, "KEY_PRESS") == 0 &&
+        if (sticky_key->config->behavior.behavior == key_press_behavior &&
             ZMK_HID_USAGE_ID(sticky_key->param1) == ev_copy.keycode &&
             ZMK_HID_USAGE_PAGE(sticky_key->param1) == ev_copy.usage_page &&
             SELECT_MODS(sticky_key->param1) == ev_copy.implicit_modifiers) {
@@ -257,25 +270,20 @@ static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
     return ZMK_EV_EVENT_BUBBLE;
 }
 
-void behavior_sticky_key_timer_handler(struct k_work *item) {
+void behavior_sticky_key_timer_handler(struct zmk_timer *timer) {
     struct active_sticky_key *sticky_key =
-        CONTAINER_OF(item, struct active_sticky_key, release_timer);
+        CONTAINER_OF(timer, struct active_sticky_key, release_timer);
     if (sticky_key->position == ZMK_BHV_STICKY_KEY_POSITION_FREE) {
         return;
     }
-    if (sticky_key->timer_cancelled) {
-        sticky_key->timer_cancelled = false;
-    } else {
-        release_sticky_key_behavior(sticky_key, sticky_key->release_at);
-    }
+    release_sticky_key_behavior(sticky_key, sticky_key->release_at);
 }
 
 static int behavior_sticky_key_init(const struct device *dev) {
     static bool init_first_run = true;
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-            k_work_init_delayable(&active_sticky_keys[i].release_timer,
-                                  behavior_sticky_key_timer_handler);
+            zmk_timer_init(&active_sticky_keys[i].release_timer, behavior_sticky_key_timer_handler);
             active_sticky_keys[i].position = ZMK_BHV_STICKY_KEY_POSITION_FREE;
         }
     }
@@ -299,4 +307,16 @@ static struct behavior_sticky_key_data behavior_sticky_key_data;
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
+#define RESOLVE_INST(n)                                                                            \
+    zmk_behavior_binding_get_device(&behavior_sticky_key_config_##n.behavior);
+
+// Resolve the key press and sticky behavior devices once all behaviors are ready
+static int behavior_sticky_key_resolve_bindings(const struct device *_arg) {
+    key_press_behavior = device_get_binding("KEY_PRESS");
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST);
+    return 0;
+}
+
+SYS_INIT(behavior_sticky_key_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif
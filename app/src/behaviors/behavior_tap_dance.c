@@ -16,6 +16,7 @@
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/keycode_state_changed.h>
 #include <zmk/hid.h>
+#include <zmk/timer.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -42,17 +43,23 @@ struct active_tap_dance {
 
     // Timer Data
     bool timer_started;
-    bool timer_cancelled;
     bool tap_dance_decided;
     int64_t release_at;
-    struct k_work_delayable release_timer;
+    struct zmk_timer release_timer;
 };
 
 struct active_tap_dance active_tap_dances[ZMK_BHV_TAP_DANCE_MAX_HELD] = {};
+// Active tap dances by key position. Tap dances on virtual key positions, e.g. in combos, are
+// found by scanning active_tap_dances instead.
+static struct active_tap_dance *active_tap_dance_by_position[ZMK_KEYMAP_LEN];
+static int active_tap_dance_count;
 
 static struct active_tap_dance *find_tap_dance(uint32_t position) {
+    if (position < ZMK_KEYMAP_LEN) {
+        return active_tap_dance_by_position[position];
+    }
     for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-        if (active_tap_dances[i].position == position && !active_tap_dances[i].timer_cancelled) {
+        if (active_tap_dances[i].position == position) {
             return &active_tap_dances[i];
         }
     }
@@ -70,8 +77,11 @@ static int new_tap_dance(uint32_t position, const struct behavior_tap_dance_conf
             ref_dance->release_at = 0;
             ref_dance->is_pressed = true;
             ref_dance->timer_started = true;
-            ref_dance->timer_cancelled = false;
             ref_dance->tap_dance_decided = false;
+            if (position < ZMK_KEYMAP_LEN) {
+                active_tap_dance_by_position[position] = ref_dance;
+            }
+            active_tap_dance_count++;
             *tap_dance = ref_dance;
             return 0;
         }
@@ -80,24 +90,25 @@ static int new_tap_dance(uint32_t position, const struct behavior_tap_dance_conf
 }
 
 static void clear_tap_dance(struct active_tap_dance *tap_dance) {
+    if (tap_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
+        return;
+    }
+    if (tap_dance->position < ZMK_KEYMAP_LEN) {
+        active_tap_dance_by_position[tap_dance->position] = NULL;
+    }
+    active_tap_dance_count--;
     tap_dance->position = ZMK_BHV_TAP_DANCE_POSITION_FREE;
 }
 
-static int stop_timer(struct active_tap_dance *tap_dance) {
-    int timer_cancel_result = k_work_cancel_delayable(&tap_dance->release_timer);
-    if (timer_cancel_result == -EINPROGRESS) {
-        // too late to cancel, we'll let the timer handler clear up.
-        tap_dance->timer_cancelled = true;
-    }
-    return timer_cancel_result;
+static void stop_timer(struct active_tap_dance *tap_dance) {
+    zmk_timer_stop(&tap_dance->release_timer);
 }
 
 static void reset_timer(struct active_tap_dance *tap_dance,
                         struct zmk_behavior_binding_event event) {
     tap_dance->release_at = event.timestamp + tap_dance->config->tapping_term_ms;
-    int32_t ms_left = tap_dance->release_at - k_uptime_get();
-    if (ms_left > 0) {
-        k_work_schedule(&tap_dance->release_timer, K_MSEC(ms_left));
+    if (tap_dance->release_at > k_uptime_get()) {
+        zmk_timer_start(&tap_dance->release_timer, tap_dance->release_at);
         LOG_DBG("Successfully reset timer at position %d", tap_dance->position);
     }
 }
@@ -125,7 +136,7 @@ static inline int release_tap_dance_behavior(struct active_tap_dance *tap_dance,
 
 static int on_tap_dance_binding_pressed(struct zmk_behavior_binding *binding,
                                         struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_tap_dance_config *cfg = dev->config;
     struct active_tap_dance *tap_dance;
     tap_dance = find_tap_dance(event.position);
@@ -168,14 +179,12 @@ static int on_tap_dance_binding_released(struct zmk_behavior_binding *binding,
     return ZMK_BEHAVIOR_OPAQUE;
 }
 
-void behavior_tap_dance_timer_handler(struct k_work *item) {
-    struct active_tap_dance *tap_dance = CONTAINER_OF(item, struct active_tap_dance, release_timer);
+void behavior_tap_dance_timer_handler(struct zmk_timer *timer) {
+    struct active_tap_dance *tap_dance =
+        CONTAINER_OF(timer, struct active_tap_dance, release_timer);
     if (tap_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
         return;
     }
-    if (tap_dance->timer_cancelled) {
-        return;
-    }
     LOG_DBG("Tap dance has been decided via timer. Counter reached: %d", tap_dance->counter);
     press_tap_dance_behavior(tap_dance, tap_dance->release_at);
     if (tap_dance->is_pressed) {
@@ -203,6 +212,9 @@ static int tap_dance_position_state_changed_listener(const zmk_event_t *eh) {
         LOG_DBG("Ignore upstroke at position %d.", ev->position);
         return ZMK_EV_EVENT_BUBBLE;
     }
+    if (active_tap_dance_count == 0) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
         struct active_tap_dance *tap_dance = &active_tap_dances[i];
         if (tap_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
@@ -228,9 +240,8 @@ static int behavior_tap_dance_init(const struct device *dev) {
     static bool init_first_run = true;
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-            k_work_init_delayable(&active_tap_dances[i].release_timer,
-                                  behavior_tap_dance_timer_handler);
-            clear_tap_dance(&active_tap_dances[i]);
+            zmk_timer_init(&active_tap_dances[i].release_timer, behavior_tap_dance_timer_handler);
+            active_tap_dances[i].position = ZMK_BHV_TAP_DANCE_POSITION_FREE;
         }
     }
     init_first_run = false;
@@ -256,4 +267,17 @@ static int behavior_tap_dance_init(const struct device *dev) {
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
+#define RESOLVE_INST(n)                                                                            \
+    for (int i = 0; i < DT_INST_PROP_LEN(n, bindings); i++) {                                      \
+        zmk_behavior_binding_get_device(&behavior_tap_dance_config_##n##_bindings[i]);             \
+    }
+
+// Resolve the tap dance behavior devices once all behaviors are ready
+static int behavior_tap_dance_resolve_bindings(const struct device *_arg) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST);
+    return 0;
+}
+
+SYS_INIT(behavior_tap_dance_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif
\ No newline at end of file
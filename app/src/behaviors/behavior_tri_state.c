@@ -17,6 +17,7 @@
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/layer_state_changed.h>
 #include <zmk/hid.h>
+#include <zmk/timer.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -40,26 +41,19 @@ struct active_tri_state {
     bool first_press;
     uint32_t position;
     const struct behavior_tri_state_config *config;
-    struct k_work_delayable release_timer;
+    struct zmk_timer release_timer;
     int64_t release_at;
     bool timer_started;
-    bool timer_cancelled;
 };
 
-static int stop_timer(struct active_tri_state *tri_state) {
-    int timer_cancel_result = k_work_cancel_delayable(&tri_state->release_timer);
-    if (timer_cancel_result == -EINPROGRESS) {
-        // too late to cancel, we'll let the timer handler clear up.
-        tri_state->timer_cancelled = true;
-    }
-    return timer_cancel_result;
+static void stop_timer(struct active_tri_state *tri_state) {
+    zmk_timer_stop(&tri_state->release_timer);
 }
 
 static void reset_timer(int32_t timestamp, struct active_tri_state *tri_state) {
     tri_state->release_at = timestamp + tri_state->config->timeout_ms;
-    int32_t ms_left = tri_state->release_at - k_uptime_get();
-    if (ms_left > 0) {
-        k_work_schedule(&tri_state->release_timer, K_MSEC(ms_left));
+    if (tri_state->release_at > k_uptime_get()) {
+        zmk_timer_start(&tri_state->release_timer, tri_state->release_at);
         LOG_DBG("Successfully reset tri-state timer");
     }
 }
@@ -69,21 +63,45 @@ void trigger_end_behavior(struct active_tri_state *si) {
     zmk_behavior_queue_add(si->position, si->config->end_behavior, false, 0);
 }
 
-void behavior_tri_state_timer_handler(struct k_work *item) {
-    struct active_tri_state *tri_state = CONTAINER_OF(item, struct active_tri_state, release_timer);
-    if (!tri_state->is_active || tri_state->timer_cancelled || tri_state->is_pressed) {
+static void clear_tri_state(struct active_tri_state *tri_state);
+
+void behavior_tri_state_timer_handler(struct zmk_timer *timer) {
+    struct active_tri_state *tri_state =
+        CONTAINER_OF(timer, struct active_tri_state, release_timer);
+    if (!tri_state->is_active || tri_state->is_pressed) {
         return;
     }
     LOG_DBG("Tri-state deactivated due to timer");
-    tri_state->is_active = false;
+    clear_tri_state(tri_state);
     trigger_end_behavior(tri_state);
 }
 
-static void clear_tri_state(struct active_tri_state *tri_state) { tri_state->is_active = false; }
-
 struct active_tri_state active_tri_states[ZMK_BHV_MAX_ACTIVE_TRI_STATES] = {};
+// Active tri-states by key position. Tri-states on virtual key positions, e.g. in combos, are
+// found by scanning active_tri_states instead.
+static struct active_tri_state *active_tri_state_by_position[ZMK_KEYMAP_LEN];
+static int active_tri_state_count;
+
+// The position and layer listener is only enabled while there are active tri-states.
+const struct zmk_listener zmk_listener_behavior_tri_state;
+
+static void clear_tri_state(struct active_tri_state *tri_state) {
+    if (!tri_state->is_active) {
+        return;
+    }
+    if (tri_state->position < ZMK_KEYMAP_LEN) {
+        active_tri_state_by_position[tri_state->position] = NULL;
+    }
+    if (--active_tri_state_count == 0) {
+        ZMK_LISTENER_DISABLE(behavior_tri_state);
+    }
+    tri_state->is_active = false;
+}
 
 static struct active_tri_state *find_tri_state(uint32_t position) {
+    if (position < ZMK_KEYMAP_LEN) {
+        return active_tri_state_by_position[position];
+    }
     for (int i = 0; i < ZMK_BHV_MAX_ACTIVE_TRI_STATES; i++) {
         if (active_tri_states[i].position == position && active_tri_states[i].is_active) {
             return &active_tri_states[i];
@@ -102,6 +120,12 @@ static int new_tri_state(uint32_t position, const struct behavior_tri_state_conf
             ref_tri_state->is_active = true;
             ref_tri_state->is_pressed = false;
             ref_tri_state->first_press = true;
+            if (position < ZMK_KEYMAP_LEN) {
+                active_tri_state_by_position[position] = ref_tri_state;
+            }
+            if (active_tri_state_count++ == 0) {
+                ZMK_LISTENER_ENABLE(behavior_tri_state);
+            }
             *tri_state = ref_tri_state;
             return 0;
         }
@@ -127,7 +151,7 @@ static bool is_layer_ignored(struct active_tri_state *tri_state, int32_t layer)
 
 static int on_tri_state_binding_pressed(struct zmk_behavior_binding *binding,
                                         struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_tri_state_config *cfg = dev->config;
     struct active_tri_state *tri_state;
     tri_state = find_tri_state(event.position);
@@ -164,7 +188,7 @@ static void release_tri_state(struct zmk_behavior_binding_event event,
 
 static int on_tri_state_binding_released(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_tri_state_config *cfg = dev->config;
     LOG_DBG("%d tri_state keybind released", event.position);
     release_tri_state(event, (struct zmk_behavior_binding *)&cfg->continue_behavior);
@@ -175,8 +199,7 @@ static int behavior_tri_state_init(const struct device *dev) {
     static bool init_first_run = true;
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_MAX_ACTIVE_TRI_STATES; i++) {
-            k_work_init_delayable(&active_tri_states[i].release_timer,
-                                  behavior_tri_state_timer_handler);
+            zmk_timer_init(&active_tri_states[i].release_timer, behavior_tri_state_timer_handler);
             clear_tri_state(&active_tri_states[i]);
         }
     }
@@ -193,7 +216,7 @@ static int tri_state_listener(const zmk_event_t *eh);
 static int tri_state_position_state_changed_listener(const zmk_event_t *eh);
 static int tri_state_layer_state_changed_listener(const zmk_event_t *eh);
 
-ZMK_LISTENER(behavior_tri_state, tri_state_listener);
+ZMK_LISTENER_DISABLED(behavior_tri_state, tri_state_listener);
 ZMK_SUBSCRIPTION(behavior_tri_state, zmk_position_state_changed);
 ZMK_SUBSCRIPTION(behavior_tri_state, zmk_layer_state_changed);
 
@@ -221,7 +244,7 @@ static int tri_state_position_state_changed_listener(const zmk_event_t *eh) {
         }
         if (!is_other_key_ignored(tri_state, ev->position)) {
             LOG_DBG("Tri-State interrupted, ending at %d %d", tri_state->position, ev->position);
-            tri_state->is_active = false;
+            clear_tri_state(tri_state);
             struct zmk_behavior_binding_event event = {.position = tri_state->position,
                                                        .timestamp = k_uptime_get()};
             if (tri_state->is_pressed) {
@@ -255,7 +278,7 @@ static int tri_state_layer_state_changed_listener(const zmk_event_t *eh) {
         }
         if (!is_layer_ignored(tri_state, ev->layer)) {
             LOG_DBG("Tri-State layer changed, ending at %d %d", tri_state->position, ev->layer);
-            tri_state->is_active = false;
+            clear_tri_state(tri_state);
             struct zmk_behavior_binding_event event = {.position = tri_state->position,
                                                        .timestamp = k_uptime_get()};
             if (tri_state->is_pressed) {
@@ -299,3 +322,16 @@ static int tri_state_layer_state_changed_listener(const zmk_event_t *eh) {
                           &behavior_tri_state_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(TRI_STATE_INST)
+
+#define RESOLVE_INST(n)                                                                            \
+    zmk_behavior_binding_get_device(&behavior_tri_state_config_##n.start_behavior);                \
+    zmk_behavior_binding_get_device(&behavior_tri_state_config_##n.continue_behavior);             \
+    zmk_behavior_binding_get_device(&behavior_tri_state_config_##n.end_behavior);
+
+// Resolve the start, continue and end behavior devices once all behaviors are ready
+static int behavior_tri_state_resolve_bindings(const struct device *_arg) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST);
+    return 0;
+}
+
+SYS_INIT(behavior_tri_state_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -16,25 +16,44 @@
 #include <zmk/behavior.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
-#include <zmk/events/keycode_state_changed.h>
+#include <zmk/keystroke_timing.h>
 #include <zmk/hid.h>
 #include <zmk/matrix.h>
 #include <zmk/keymap.h>
 #include <zmk/virtual_key_position.h>
+#include <zmk/timer.h>
+
+#include <zmk_position_sets.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
+#define COMBO_INDEX(n) UTIL_CAT(COMBO_INDEX_, n)
+#define COMBO_INDEX_ENTRY(n) COMBO_INDEX(n),
+
+// combo indices in devicetree order
+enum { DT_INST_FOREACH_CHILD(0, COMBO_INDEX_ENTRY) COMBO_COUNT };
+
+// Sets of combos and of key positions are kept as bitsets, one bit per combo or position
+#define COMBO_WORDS DIV_ROUND_UP(COMBO_COUNT, 32)
+#define POSITION_WORDS DIV_ROUND_UP(ZMK_KEYMAP_LEN, 32)
+
 struct combo_cfg {
-    int32_t key_positions[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
-    int32_t key_position_len;
-    struct zmk_behavior_binding behavior;
+    // the key positions of a combo are only stored as a mask, so combos with more keys take no
+    // more space
+    uint32_t key_position_mask[POSITION_WORDS];
+    uint8_t key_position_len;
+    // the binding is kept in RAM so it can cache its behavior device
+    struct zmk_behavior_binding *behavior;
     int32_t timeout_ms;
     int32_t require_prior_idle_ms;
     // if slow release is set, the combo releases when the last key is released.
     // otherwise, the combo releases when the first key is released.
     bool slow_release;
+    // if eager press is set and all combos a key may start are eager, the key is pressed right away
+    // instead of being held back. It is released again if the combo is triggered.
+    bool eager_press;
     // the virtual key position is a key position outside the range used by the keyboard.
     // it is necessary so hold-taps can uniquely identify a behavior.
     int32_t virtual_key_position;
@@ -43,86 +62,115 @@ struct combo_cfg {
 };
 
 struct active_combo {
-    struct combo_cfg *combo;
-    // key_positions_pressed is filled with key_positions when the combo is pressed.
-    // The keys are removed from this array when they are released.
-    // Once this array is empty, the behavior is released.
-    const zmk_event_t *key_positions_pressed[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
+    sys_dnode_t node;
+    const struct combo_cfg *combo;
+    // key_positions_pressed is set to the combo's key positions when the combo is pressed.
+    // The keys are removed from this set when they are released.
+    // Once this set is empty, the behavior is released.
+    uint32_t key_positions_pressed[POSITION_WORDS];
 };
 
-struct combo_candidate {
-    struct combo_cfg *combo;
-    // the time after which this behavior should be removed from candidates.
-    // by keeping track of when the candidate should be cleared there is no
-    // possibility of accidental releases.
-    int64_t timeout_at;
+// Everything known about the combos at build time is emitted as constant tables, so RAM only holds
+// the state of pressed keys and candidates. The sets of key positions and of combos are generated
+// from the devicetree by scripts/gen_position_sets.py, one initializer per word.
+
+#define COMBO_KEY(n, i) DT_PROP_BY_IDX(n, key_positions, i)
+#define COMBO_LEN(n) DT_PROP_LEN(n, key_positions)
+
+#define COMBO_POSITION_VALID(i, n) (COMBO_KEY(n, i) < ZMK_KEYMAP_LEN)
+
+// Combos are preferred shortest-first, then by definition order, which is also the order of their
+// virtual key positions. A combo's rank in that order is its bit in a set of combos.
+#define COMBO_RANK(n) UTIL_CAT(ZMK_COMBO_RANK_, n)
+
+#define COMBO_INST(n)                                                                              \
+    BUILD_ASSERT(LISTIFY(COMBO_LEN(n), COMBO_POSITION_VALID, (&&), n),                             \
+                 "Combo key position does not exist in the keymap");                               \
+    static struct zmk_behavior_binding combo_binding_##n = ZMK_KEYMAP_EXTRACT_BINDING(0, n);       \
+    static const struct combo_cfg combo_config_##n = {                                             \
+        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
+        .require_prior_idle_ms = DT_PROP(n, require_prior_idle_ms),                                \
+        .key_position_len = COMBO_LEN(n),                                                          \
+        .key_position_mask = UTIL_CAT(ZMK_COMBO_KEY_MASK_, n),                                     \
+        .behavior = &combo_binding_##n,                                                            \
+        .virtual_key_position = ZMK_VIRTUAL_KEY_POSITION_COMBO(__COUNTER__),                       \
+        .slow_release = DT_PROP(n, slow_release),                                                  \
+        .eager_press = DT_PROP(n, eager_press),                                                    \
+        .layers = DT_PROP(n, layers),                                                              \
+        .layers_len = DT_PROP_LEN(n, layers),                                                      \
+    };
+
+#define COMBO_ENTRY(n) [COMBO_RANK(n)] = &combo_config_##n,
+
+DT_INST_FOREACH_CHILD(0, COMBO_INST)
+
+// all combos, sorted shortest-first, then by virtual-key-position. A combo's index in this array
+// is its bit in a set of combos, so the lowest set bit is the preferred combo.
+static const struct combo_cfg *const combos[COMBO_COUNT] = {DT_INST_FOREACH_CHILD(0, COMBO_ENTRY)};
+
+// the size of this union is the number of keys of the longest combo
+#define COMBO_KEYS_MEMBER(n) uint8_t keys_##n[COMBO_LEN(n)];
+union combo_max_keys {
+    DT_INST_FOREACH_CHILD(0, COMBO_KEYS_MEMBER)
 };
+#define COMBO_MAX_KEYS sizeof(union combo_max_keys)
+
+// A key that is part of an active combo can't start another combo until it is released, so no
+// more combos than keys can be active at once.
+#define COMBO_MAX_ACTIVE MIN(COMBO_COUNT, ZMK_KEYMAP_LEN)
+
+// the set of combos that use each key position
+static const uint32_t combos_by_position[ZMK_KEYMAP_LEN][COMBO_WORDS] = ZMK_COMBOS_BY_POSITION;
 
 // set of keys pressed
-const zmk_event_t *pressed_keys[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO] = {NULL};
-// the set of candidate combos based on the currently pressed_keys
-struct combo_candidate candidates[CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY];
+const zmk_event_t *pressed_keys[COMBO_MAX_KEYS] = {NULL};
+// the positions of the keys in pressed_keys
+uint32_t pressed_key_positions[POSITION_WORDS];
+// keys that were let through when pressed, since all their candidates are eager press combos
+struct zmk_position_state_changed eager_keys[COMBO_MAX_KEYS];
+int eager_key_count = 0;
+// the positions of the keys in eager_keys
+uint32_t eager_key_positions[POSITION_WORDS];
+// the set of candidate combos based on the currently pressed_keys and eager_keys
+uint32_t candidates[COMBO_WORDS];
+// the time the first key of the current candidates was pressed. Candidates are removed once their
+// timeout has passed since then. By keeping track of when the candidates should be cleared there
+// is no possibility of accidental releases.
+int64_t candidates_pressed_at;
 // the last candidate that was completely pressed
-struct combo_cfg *fully_pressed_combo = NULL;
-// a lookup dict that maps a key position to all combos on that position
-struct combo_cfg *combo_lookup[ZMK_KEYMAP_LEN][CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY] = {NULL};
-// combos that have been activated and still have (some) keys pressed
-// this array is always contiguous from 0.
-struct active_combo active_combos[CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS] = {NULL};
-int active_combo_count = 0;
-
-struct k_work_delayable timeout_task;
+const struct combo_cfg *fully_pressed_combo = NULL;
+// storage for the combos that have been activated and still have (some) keys pressed. Entries are
+// taken in order until all have been used once, after that from the free list.
+struct active_combo active_combo_storage[COMBO_MAX_ACTIVE];
+int active_combo_storage_used = 0;
+// the activated combos, and the free entries of active_combo_storage
+sys_dlist_t active_combos = SYS_DLIST_STATIC_INIT(&active_combos);
+sys_dlist_t free_active_combos = SYS_DLIST_STATIC_INIT(&free_active_combos);
+
+static void combo_timeout_handler(struct zmk_timer *timer);
+static ZMK_TIMER_DEFINE(timeout_task, combo_timeout_handler);
 int64_t timeout_task_timeout_at;
 
-// this keeps track of the last non-combo, non-mod key tap
-int64_t last_tapped_timestamp = INT32_MIN;
-// this keeps track of the last time a combo was pressed
+// this keeps track of the last time a combo was pressed, so the keys it pressed itself don't count
+// as typing for require-prior-idle-ms
 int64_t last_combo_timestamp = INT32_MIN;
 
-static void store_last_tapped(int64_t timestamp) {
-    if (timestamp > last_combo_timestamp) {
-        last_tapped_timestamp = timestamp;
-    }
-}
+static inline void bitset_set(uint32_t *set, int bit) { set[bit / 32] |= BIT(bit % 32); }
 
-// Store the combo key pointer in the combos array, one pointer for each key position
-// The combos are sorted shortest-first, then by virtual-key-position.
-static int initialize_combo(struct combo_cfg *new_combo) {
-    for (int i = 0; i < new_combo->key_position_len; i++) {
-        int32_t position = new_combo->key_positions[i];
-        if (position >= ZMK_KEYMAP_LEN) {
-            LOG_ERR("Unable to initialize combo, key position %d does not exist", position);
-            return -EINVAL;
-        }
+static inline void bitset_clear(uint32_t *set, int bit) { set[bit / 32] &= ~BIT(bit % 32); }
 
-        struct combo_cfg *insert_combo = new_combo;
-        bool set = false;
-        for (int j = 0; j < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; j++) {
-            struct combo_cfg *combo_at_j = combo_lookup[position][j];
-            if (combo_at_j == NULL) {
-                combo_lookup[position][j] = insert_combo;
-                set = true;
-                break;
-            }
-            if (combo_at_j->key_position_len < insert_combo->key_position_len ||
-                (combo_at_j->key_position_len == insert_combo->key_position_len &&
-                 combo_at_j->virtual_key_position < insert_combo->virtual_key_position)) {
-                continue;
-            }
-            // put insert_combo in this spot, move all other combos up.
-            combo_lookup[position][j] = insert_combo;
-            insert_combo = combo_at_j;
-        }
-        if (!set) {
-            LOG_ERR("Too many combos for key position %d, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY %d.",
-                    position, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY);
-            return -ENOMEM;
-        }
-    }
-    return 0;
+// Iterates over the set bits of a bitset of `words` words, lowest first
+#define BITSET_FOR_EACH(set, words, bit)                                                           \
+    for (int _word = 0; _word < (words); _word++)                                                  \
+        for (uint32_t _bits = (set)[_word], bit;                                                   \
+             _bits != 0 && (bit = _word * 32 + find_lsb_set(_bits) - 1, true);                     \
+             _bits &= _bits - 1)
+
+static inline bool combo_has_position(const struct combo_cfg *combo, int32_t position) {
+    return (combo->key_position_mask[position / 32] & BIT(position % 32)) != 0;
 }
 
-static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
+static bool combo_active_on_layer(const struct combo_cfg *combo, uint8_t layer) {
     if (combo->layers[0] == -1) {
         // -1 in the first layer position is global layer scope
         return true;
@@ -135,83 +183,80 @@ static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
     return false;
 }
 
-static bool is_quick_tap(struct combo_cfg *combo, int64_t timestamp) {
-    return (last_tapped_timestamp + combo->require_prior_idle_ms) > timestamp;
+static bool is_quick_tap(const struct combo_cfg *combo, int64_t timestamp) {
+    return (zmk_keystroke_timing_last_tap_except(last_combo_timestamp) +
+            combo->require_prior_idle_ms) > timestamp;
 }
 
 static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
+    if (position >= ZMK_KEYMAP_LEN) {
+        return 0;
+    }
     int number_of_combo_candidates = 0;
     uint8_t highest_active_layer = zmk_keymap_highest_layer_active();
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_cfg *combo = combo_lookup[position][i];
-        if (combo == NULL) {
-            return number_of_combo_candidates;
-        }
+    candidates_pressed_at = timestamp;
+    BITSET_FOR_EACH(combos_by_position[position], COMBO_WORDS, index) {
+        const struct combo_cfg *combo = combos[index];
         if (combo_active_on_layer(combo, highest_active_layer) && !is_quick_tap(combo, timestamp)) {
-            candidates[number_of_combo_candidates].combo = combo;
-            candidates[number_of_combo_candidates].timeout_at = timestamp + combo->timeout_ms;
+            bitset_set(candidates, index);
             number_of_combo_candidates++;
         }
-        // LOG_DBG("combo timeout %d %d %d", position, i, candidates[i].timeout_at);
     }
     return number_of_combo_candidates;
 }
 
 static int filter_candidates(int32_t position) {
-    // this code iterates over candidates and the lookup together to filter in O(n)
-    // assuming they are both sorted on key_position_len, virtal_key_position
-    int matches = 0, lookup_idx = 0, candidate_idx = 0;
-    while (lookup_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY &&
-           candidate_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY) {
-        struct combo_cfg *candidate = candidates[candidate_idx].combo;
-        struct combo_cfg *lookup = combo_lookup[position][lookup_idx];
-        if (candidate == NULL || lookup == NULL) {
-            break;
-        }
-        if (candidate->virtual_key_position == lookup->virtual_key_position) {
-            candidates[matches] = candidates[candidate_idx];
-            matches++;
-            candidate_idx++;
-            lookup_idx++;
-        } else if (candidate->key_position_len > lookup->key_position_len) {
-            lookup_idx++;
-        } else if (candidate->key_position_len < lookup->key_position_len) {
-            candidate_idx++;
-        } else if (candidate->virtual_key_position > lookup->virtual_key_position) {
-            lookup_idx++;
-        } else if (candidate->virtual_key_position < lookup->virtual_key_position) {
-            candidate_idx++;
-        }
-    }
-    // clear unmatched candidates
-    for (int i = matches; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        candidates[i].combo = NULL;
+    int matches = 0;
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        candidates[i] &= position < ZMK_KEYMAP_LEN ? combos_by_position[position][i] : 0;
+        matches += __builtin_popcount(candidates[i]);
     }
     // LOG_DBG("combo matches after filter %d", matches);
     return matches;
 }
 
+// the first candidate is the shortest one, and the one defined first among those
+static const struct combo_cfg *first_candidate() {
+    BITSET_FOR_EACH(candidates, COMBO_WORDS, index) { return combos[index]; }
+    return NULL;
+}
+
 static int64_t first_candidate_timeout() {
-    int64_t first_timeout = LONG_MAX;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            break;
-        }
-        if (candidates[i].timeout_at < first_timeout) {
-            first_timeout = candidates[i].timeout_at;
+    int64_t first_timeout = LLONG_MAX;
+    BITSET_FOR_EACH(candidates, COMBO_WORDS, index) {
+        int64_t timeout_at = candidates_pressed_at + combos[index]->timeout_ms;
+        if (timeout_at < first_timeout) {
+            first_timeout = timeout_at;
         }
     }
     return first_timeout;
 }
 
-static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate) {
-    // this code assumes set(pressed_keys) <= set(candidate->key_positions)
-    // this invariant is enforced by filter_candidates
-    // since events may have been reraised after clearing one or more slots at
-    // the start of pressed_keys (see: release_pressed_keys), we have to check
-    // that each key needed to trigger the combo was pressed, not just the last.
-    for (int i = 0; i < candidate->key_position_len; i++) {
-        if (pressed_keys[i] == NULL) {
+static inline bool candidate_is_completely_pressed(const struct combo_cfg *candidate) {
+    // all keys of the candidate must be among the captured or eagerly pressed keys. Only positions
+    // of keys that are still in pressed_keys count, so keys being reraised (see:
+    // release_pressed_keys) have to be captured again first.
+    for (int i = 0; i < POSITION_WORDS; i++) {
+        if ((candidate->key_position_mask[i] &
+             ~(pressed_key_positions[i] | eager_key_positions[i])) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool candidates_are_completely_pressed() {
+    BITSET_FOR_EACH(candidates, COMBO_WORDS, index) {
+        if (!candidate_is_completely_pressed(combos[index])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool candidates_are_eager() {
+    BITSET_FOR_EACH(candidates, COMBO_WORDS, index) {
+        if (!combos[index]->eager_press) {
             return false;
         }
     }
@@ -222,25 +267,11 @@ static int cleanup();
 
 static int filter_timed_out_candidates(int64_t timestamp) {
     int remaining_candidates = 0;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_candidate *candidate = &candidates[i];
-        if (candidate->combo == NULL) {
-            break;
-        }
-        if (candidate->timeout_at > timestamp) {
-            bool need_to_bubble_up = remaining_candidates != i;
-            if (need_to_bubble_up) {
-                // bubble up => reorder candidates so they're contiguous
-                candidates[remaining_candidates].combo = candidate->combo;
-                candidates[remaining_candidates].timeout_at = candidate->timeout_at;
-                // clear the previous location
-                candidates[i].combo = NULL;
-                candidates[i].timeout_at = 0;
-            }
-
+    BITSET_FOR_EACH(candidates, COMBO_WORDS, index) {
+        if (candidates_pressed_at + combos[index]->timeout_ms > timestamp) {
             remaining_candidates++;
         } else {
-            candidate->combo = NULL;
+            bitset_clear(candidates, index);
         }
     }
 
@@ -251,22 +282,15 @@ static int filter_timed_out_candidates(int64_t timestamp) {
     return remaining_candidates;
 }
 
-static int clear_candidates() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            return i;
-        }
-        candidates[i].combo = NULL;
-    }
-    return CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY;
-}
+static void clear_candidates() { memset(candidates, 0, sizeof(candidates)); }
 
 static int capture_pressed_key(const zmk_event_t *ev) {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
+    for (int i = 0; i < COMBO_MAX_KEYS; i++) {
         if (pressed_keys[i] != NULL) {
             continue;
         }
         pressed_keys[i] = ev;
+        bitset_set(pressed_key_positions, as_zmk_position_state_changed(ev)->position);
         return ZMK_EV_EVENT_CAPTURED;
     }
     return ZMK_EV_EVENT_BUBBLE;
@@ -275,7 +299,8 @@ static int capture_pressed_key(const zmk_event_t *ev) {
 const struct zmk_listener zmk_listener_combo;
 
 static int release_pressed_keys() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
+    memset(pressed_key_positions, 0, sizeof(pressed_key_positions));
+    for (int i = 0; i < COMBO_MAX_KEYS; i++) {
         const zmk_event_t *captured_event = pressed_keys[i];
         if (pressed_keys[i] == NULL) {
             return i;
@@ -292,10 +317,10 @@ static int release_pressed_keys() {
             ZMK_EVENT_RAISE(captured_event);
         }
     }
-    return CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO;
+    return COMBO_MAX_KEYS;
 }
 
-static inline int press_combo_behavior(struct combo_cfg *combo, int32_t timestamp) {
+static inline int press_combo_behavior(const struct combo_cfg *combo, int32_t timestamp) {
     struct zmk_behavior_binding_event event = {
         .position = combo->virtual_key_position,
         .timestamp = timestamp,
@@ -303,26 +328,30 @@ static inline int press_combo_behavior(struct combo_cfg *combo, int32_t timestam
 
     last_combo_timestamp = timestamp;
 
-    return behavior_keymap_binding_pressed(&combo->behavior, event);
+    return behavior_keymap_binding_pressed(combo->behavior, event);
 }
 
-static inline int release_combo_behavior(struct combo_cfg *combo, int32_t timestamp) {
+static inline int release_combo_behavior(const struct combo_cfg *combo, int32_t timestamp) {
     struct zmk_behavior_binding_event event = {
         .position = combo->virtual_key_position,
         .timestamp = timestamp,
     };
 
-    return behavior_keymap_binding_released(&combo->behavior, event);
+    return behavior_keymap_binding_released(combo->behavior, event);
 }
 
 static void move_pressed_keys_to_active_combo(struct active_combo *active_combo) {
-    int combo_length = active_combo->combo->key_position_len;
+    // the eagerly pressed keys of the combo were pressed before any key was captured
+    int combo_length = active_combo->combo->key_position_len - eager_key_count;
     for (int i = 0; i < combo_length; i++) {
-        active_combo->key_positions_pressed[i] = pressed_keys[i];
+        uint32_t position = as_zmk_position_state_changed(pressed_keys[i])->position;
+        bitset_set(active_combo->key_positions_pressed, position);
+        bitset_clear(pressed_key_positions, position);
+        ZMK_EVENT_FREE(pressed_keys[i]);
         pressed_keys[i] = NULL;
     }
     // move any other pressed keys up
-    for (int i = 0; i + combo_length < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
+    for (int i = 0; i + combo_length < COMBO_MAX_KEYS; i++) {
         if (pressed_keys[i + combo_length] == NULL) {
             return;
         }
@@ -331,84 +360,103 @@ static void move_pressed_keys_to_active_combo(struct active_combo *active_combo)
     }
 }
 
-static struct active_combo *store_active_combo(struct combo_cfg *combo) {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS; i++) {
-        if (active_combos[i].combo == NULL) {
-            active_combos[i].combo = combo;
-            active_combo_count++;
-            return &active_combos[i];
-        }
+// Undo the eager presses of a combo that is triggered. The physical releases of these keys then
+// belong to the combo.
+static void release_eager_keys(struct active_combo *active_combo) {
+    for (int i = 0; i < eager_key_count; i++) {
+        struct zmk_position_state_changed release = eager_keys[i];
+        release.state = false;
+        release.timestamp = k_uptime_get();
+        bitset_set(active_combo->key_positions_pressed, release.position);
+        LOG_DBG("combo: releasing eagerly pressed position %d", release.position);
+        ZMK_EVENT_RAISE_AFTER(new_zmk_position_state_changed(release), combo);
     }
-    LOG_ERR("Unable to store combo; already %d active. Increase "
-            "CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS",
-            CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS);
-    return NULL;
 }
 
-static void activate_combo(struct combo_cfg *combo) {
+static void clear_eager_keys() {
+    eager_key_count = 0;
+    memset(eager_key_positions, 0, sizeof(eager_key_positions));
+}
+
+static struct active_combo *store_active_combo(const struct combo_cfg *combo) {
+    sys_dnode_t *node = sys_dlist_get(&free_active_combos);
+    struct active_combo *active_combo;
+    if (node != NULL) {
+        active_combo = CONTAINER_OF(node, struct active_combo, node);
+    } else if (active_combo_storage_used < COMBO_MAX_ACTIVE) {
+        active_combo = &active_combo_storage[active_combo_storage_used++];
+    } else {
+        LOG_ERR("Unable to store combo; already %d active", COMBO_MAX_ACTIVE);
+        return NULL;
+    }
+
+    active_combo->combo = combo;
+    memset(active_combo->key_positions_pressed, 0, sizeof(active_combo->key_positions_pressed));
+    sys_dlist_append(&active_combos, &active_combo->node);
+    return active_combo;
+}
+
+static void activate_combo(const struct combo_cfg *combo) {
     struct active_combo *active_combo = store_active_combo(combo);
     if (active_combo == NULL) {
         // unable to store combo
         release_pressed_keys();
         return;
     }
+    int64_t timestamp = eager_key_count > 0
+                            ? eager_keys[0].timestamp
+                            : as_zmk_position_state_changed(pressed_keys[0])->timestamp;
     move_pressed_keys_to_active_combo(active_combo);
-    press_combo_behavior(
-        combo, as_zmk_position_state_changed(active_combo->key_positions_pressed[0])->timestamp);
+    release_eager_keys(active_combo);
+    press_combo_behavior(combo, timestamp);
 }
 
-static void deactivate_combo(int active_combo_index) {
-    active_combo_count--;
-    if (active_combo_index != active_combo_count) {
-        memcpy(&active_combos[active_combo_index], &active_combos[active_combo_count],
-               sizeof(struct active_combo));
-    }
-    active_combos[active_combo_count].combo = NULL;
-    active_combos[active_combo_count] = (struct active_combo){0};
+static void deactivate_combo(struct active_combo *active_combo) {
+    sys_dlist_remove(&active_combo->node);
+    active_combo->combo = NULL;
+    sys_dlist_append(&free_active_combos, &active_combo->node);
 }
 
 /* returns true if a key was released. */
 static bool release_combo_key(int32_t position, int64_t timestamp) {
-    for (int combo_idx = 0; combo_idx < active_combo_count; combo_idx++) {
-        struct active_combo *active_combo = &active_combos[combo_idx];
+    struct active_combo *active_combo;
+    SYS_DLIST_FOR_EACH_CONTAINER(&active_combos, active_combo, node) {
+        if ((active_combo->key_positions_pressed[position / 32] & BIT(position % 32)) == 0) {
+            continue;
+        }
 
-        bool key_released = false;
-        bool all_keys_pressed = true;
+        bool all_keys_pressed =
+            memcmp(active_combo->key_positions_pressed, active_combo->combo->key_position_mask,
+                   sizeof(active_combo->key_positions_pressed)) == 0;
+        bitset_clear(active_combo->key_positions_pressed, position);
         bool all_keys_released = true;
-        for (int i = 0; i < active_combo->combo->key_position_len; i++) {
-            if (active_combo->key_positions_pressed[i] == NULL) {
-                all_keys_pressed = false;
-            } else if (as_zmk_position_state_changed(active_combo->key_positions_pressed[i])
-                           ->position != position) {
+        for (int i = 0; i < POSITION_WORDS; i++) {
+            if (active_combo->key_positions_pressed[i] != 0) {
                 all_keys_released = false;
-            } else { // not null and position matches
-                ZMK_EVENT_FREE(active_combo->key_positions_pressed[i]);
-                active_combo->key_positions_pressed[i] = NULL;
-                key_released = true;
             }
         }
 
-        if (key_released) {
-            if ((active_combo->combo->slow_release && all_keys_released) ||
-                (!active_combo->combo->slow_release && all_keys_pressed)) {
-                release_combo_behavior(active_combo->combo, timestamp);
-            }
-            if (all_keys_released) {
-                deactivate_combo(combo_idx);
-            }
-            return true;
+        if ((active_combo->combo->slow_release && all_keys_released) ||
+            (!active_combo->combo->slow_release && all_keys_pressed)) {
+            release_combo_behavior(active_combo->combo, timestamp);
         }
+        if (all_keys_released) {
+            deactivate_combo(active_combo);
+        }
+        return true;
     }
     return false;
 }
 
 static int cleanup() {
-    k_work_cancel_delayable(&timeout_task);
+    zmk_timer_stop(&timeout_task);
+    timeout_task_timeout_at = 0;
     clear_candidates();
     if (fully_pressed_combo != NULL) {
         activate_combo(fully_pressed_combo);
         fully_pressed_combo = NULL;
     }
+    clear_eager_keys();
     return release_pressed_keys();
 }
 
@@ -419,17 +467,16 @@ static void update_timeout_task() {
     }
     if (first_timeout == LLONG_MAX) {
         timeout_task_timeout_at = 0;
-        k_work_cancel_delayable(&timeout_task);
+        zmk_timer_stop(&timeout_task);
         return;
     }
-    if (k_work_schedule(&timeout_task, K_MSEC(first_timeout - k_uptime_get())) >= 0) {
-        timeout_task_timeout_at = first_timeout;
-    }
+    zmk_timer_start(&timeout_task, first_timeout);
+    timeout_task_timeout_at = first_timeout;
 }
 
 static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_changed *data) {
     int num_candidates;
-    if (candidates[0].combo == NULL) {
+    if (first_candidate() == NULL) {
         num_candidates = setup_candidates_for_first_keypress(data->position, data->timestamp);
         if (num_candidates == 0) {
             return ZMK_EV_EVENT_BUBBLE;
@@ -440,7 +487,18 @@ static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_
     }
     update_timeout_task();
 
-    struct combo_cfg *candidate_combo = candidates[0].combo;
+    const struct combo_cfg *candidate_combo = first_candidate();
+    if (num_candidates > 0 && pressed_keys[0] == NULL && candidates_are_eager()) {
+        // keys completing a combo are still captured, there is no point in pressing them first
+        bitset_set(eager_key_positions, data->position);
+        if (!candidate_is_completely_pressed(candidate_combo)) {
+            LOG_DBG("combo: eagerly pressing position %d", data->position);
+            eager_keys[eager_key_count++] = *data;
+            return ZMK_EV_EVENT_BUBBLE;
+        }
+        bitset_clear(eager_key_positions, data->position);
+    }
+
     LOG_DBG("combo: capturing position event %d", data->position);
     int ret = capture_pressed_key(ev);
     switch (num_candidates) {
@@ -456,6 +514,10 @@ static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_
     default:
         if (candidate_is_completely_pressed(candidate_combo)) {
             fully_pressed_combo = candidate_combo;
+            if (candidates_are_completely_pressed()) {
+                // no candidate can include another key, so there is nothing left to wait for
+                cleanup();
+            }
         }
         return ret;
     }
@@ -475,11 +537,7 @@ static int position_state_up(const zmk_event_t *ev, struct zmk_position_state_ch
     return ZMK_EV_EVENT_BUBBLE;
 }
 
-static void combo_timeout_handler(struct k_work *item) {
-    if (timeout_task_timeout_at == 0 || k_uptime_get() < timeout_task_timeout_at) {
-        // timer was cancelled or rescheduled.
-        return;
-    }
+static void combo_timeout_handler(struct zmk_timer *timer) {
     if (filter_timed_out_candidates(timeout_task_timeout_at) == 0) {
         cleanup();
     }
@@ -499,50 +557,14 @@ static int position_state_changed_listener(const zmk_event_t *ev) {
     }
 }
 
-static int keycode_state_changed_listener(const zmk_event_t *eh) {
-    struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
-    if (ev->state && !is_mod(ev->usage_page, ev->keycode)) {
-        store_last_tapped(ev->timestamp);
-    }
-    return ZMK_EV_EVENT_BUBBLE;
-}
-
 int behavior_combo_listener(const zmk_event_t *eh) {
     if (as_zmk_position_state_changed(eh) != NULL) {
         return position_state_changed_listener(eh);
-    } else if (as_zmk_keycode_state_changed(eh) != NULL) {
-        return keycode_state_changed_listener(eh);
     }
     return ZMK_EV_EVENT_BUBBLE;
 }
 
 ZMK_LISTENER(combo, behavior_combo_listener);
 ZMK_SUBSCRIPTION(combo, zmk_position_state_changed);
-ZMK_SUBSCRIPTION(combo, zmk_keycode_state_changed);
-
-#define COMBO_INST(n)                                                                              \
-    static struct combo_cfg combo_config_##n = {                                                   \
-        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
-        .require_prior_idle_ms = DT_PROP(n, require_prior_idle_ms),                                \
-        .key_positions = DT_PROP(n, key_positions),                                                \
-        .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
-        .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, n),                                              \
-        .virtual_key_position = ZMK_VIRTUAL_KEY_POSITION_COMBO(__COUNTER__),                       \
-        .slow_release = DT_PROP(n, slow_release),                                                  \
-        .layers = DT_PROP(n, layers),                                                              \
-        .layers_len = DT_PROP_LEN(n, layers),                                                      \
-    };
-
-#define INITIALIZE_COMBO(n) initialize_combo(&combo_config_##n);
-
-DT_INST_FOREACH_CHILD(0, COMBO_INST)
-
-static int combo_init() {
-    k_work_init_delayable(&timeout_task, combo_timeout_handler);
-    DT_INST_FOREACH_CHILD(0, INITIALIZE_COMBO);
-    return 0;
-}
-
-SYS_INIT(combo_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
 
 #endif
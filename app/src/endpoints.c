@@ -5,9 +5,11 @@
  */
 
 #include <zephyr/init.h>
+#include <zephyr/kernel.h>
 #include <zephyr/settings/settings.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include <zmk/ble.h>
 #include <zmk/endpoints.h>
@@ -16,6 +18,7 @@
 #include <zmk/usb_hid.h>
 #include <zmk/hog.h>
 #include <zmk/event_manager.h>
+#include <zmk/latency_trace.h>
 #include <zmk/events/ble_active_profile_changed.h>
 #include <zmk/events/usb_conn_state_changed.h>
 #include <zmk/events/endpoint_changed.h>
@@ -31,6 +34,8 @@ static enum zmk_transport preferred_transport =
     ZMK_TRANSPORT_USB; /* Used if multiple endpoints are ready */
 
 static void update_current_endpoint(void);
+static bool is_usb_ready(void);
+static bool is_ble_ready(void);
 
 #if IS_ENABLED(CONFIG_SETTINGS)
 static void endpoints_save_preferred_work(struct k_work *work) {
@@ -118,15 +123,166 @@ int zmk_endpoints_toggle_transport(void) {
 
 struct zmk_endpoint_instance zmk_endpoints_selected(void) { return current_instance; }
 
-static int send_keyboard_report(void) {
+// The reports last sent to an endpoint instance, so reports the host already has can be left out.
+struct endpoint_report_state {
+    bool keyboard_valid;
+    bool consumer_valid;
+    uint32_t keyboard_generation;
+    uint32_t consumer_generation;
+    struct zmk_hid_keyboard_report_body keyboard;
+    struct zmk_hid_consumer_report_body consumer;
+    // Counted atomically, as they are read from the shell thread
+    atomic_t sent;
+    atomic_t suppressed;
+};
+
+#if ZMK_ENDPOINT_COUNT > 0
+
+static struct endpoint_report_state report_states[ZMK_ENDPOINT_COUNT];
+
+static struct endpoint_report_state *get_report_state(struct zmk_endpoint_instance endpoint) {
+    int index = zmk_endpoint_instance_to_index(endpoint);
+    if (index < 0 || index >= ZMK_ENDPOINT_COUNT) {
+        return NULL;
+    }
+    return &report_states[index];
+}
+
+// Forget what was sent to every endpoint, e.g. after a connection change where the host may have
+// dropped its state.
+static void invalidate_report_states(void) {
+    for (int i = 0; i < ZMK_ENDPOINT_COUNT; i++) {
+        report_states[i].keyboard_valid = false;
+        report_states[i].consumer_valid = false;
+    }
+}
+
+static void keyboard_report_sent(struct endpoint_report_state *state,
+                                 const struct zmk_hid_keyboard_report *report) {
+    if (state == NULL) {
+        return;
+    }
+
+    state->keyboard = report->body;
+    state->keyboard_generation = zmk_hid_keyboard_report_generation();
+    state->keyboard_valid = true;
+    atomic_inc(&state->sent);
+}
+
+static void consumer_report_sent(struct endpoint_report_state *state,
+                                 const struct zmk_hid_consumer_report *report) {
+    if (state == NULL) {
+        return;
+    }
+
+    state->consumer = report->body;
+    state->consumer_generation = zmk_hid_consumer_report_generation();
+    state->consumer_valid = true;
+    atomic_inc(&state->sent);
+}
+
+static void print_report_stats(struct zmk_endpoint_instance endpoint) {
+    struct endpoint_report_state *state = get_report_state(endpoint);
+    char endpoint_str[ZMK_ENDPOINT_STR_LEN];
+    zmk_endpoint_instance_to_str(endpoint, endpoint_str, sizeof(endpoint_str));
+    printk("%-10s %10ld %10ld\n", endpoint_str, (long)atomic_get(&state->sent),
+           (long)atomic_get(&state->suppressed));
+}
+
+#else
+
+static struct endpoint_report_state *get_report_state(struct zmk_endpoint_instance endpoint) {
+    return NULL;
+}
+
+static void invalidate_report_states(void) {}
+
+#endif /* ZMK_ENDPOINT_COUNT > 0 */
+
+static bool keyboard_report_is_duplicate(struct endpoint_report_state *state,
+                                         const struct zmk_hid_keyboard_report *report) {
+    if (state == NULL || !state->keyboard_valid) {
+        return false;
+    }
+
+    if (state->keyboard_generation == zmk_hid_keyboard_report_generation()) {
+        return true;
+    }
+
+    return memcmp(&state->keyboard, &report->body, sizeof(report->body)) == 0;
+}
+
+static bool consumer_report_is_duplicate(struct endpoint_report_state *state,
+                                         const struct zmk_hid_consumer_report *report) {
+    if (state == NULL || !state->consumer_valid) {
+        return false;
+    }
+
+    if (state->consumer_generation == zmk_hid_consumer_report_generation()) {
+        return true;
+    }
+
+    return memcmp(&state->consumer, &report->body, sizeof(report->body)) == 0;
+}
+
+int zmk_endpoints_get_report_stats(struct zmk_endpoint_instance endpoint,
+                                   struct zmk_endpoint_report_stats *stats) {
+    struct endpoint_report_state *state = get_report_state(endpoint);
+    if (state == NULL) {
+        return -EINVAL;
+    }
+
+    stats->sent = atomic_get(&state->sent);
+    stats->suppressed = atomic_get(&state->suppressed);
+    return 0;
+}
+
+void zmk_endpoints_print_report_stats(void) {
+    printk("%-10s %10s %10s\n", "endpoint", "sent", "suppressed");
+#if IS_ENABLED(CONFIG_ZMK_USB)
+    print_report_stats((struct zmk_endpoint_instance){.transport = ZMK_TRANSPORT_USB});
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BLE)
+    for (int i = 0; i < ZMK_BLE_PROFILE_COUNT; i++) {
+        print_report_stats(
+            (struct zmk_endpoint_instance){.transport = ZMK_TRANSPORT_BLE, .ble.profile_index = i});
+    }
+#endif
+}
+
+#if IS_ENABLED(CONFIG_SHELL)
+
+#include <zephyr/shell/shell.h>
+
+static int cmd_report_stats(const struct shell *sh, size_t argc, char **argv) {
+    zmk_endpoints_print_report_stats();
+    return 0;
+}
+
+SHELL_CMD_REGISTER(zmk_endpoint_reports, NULL, "Print HID reports sent and suppressed per endpoint",
+                   cmd_report_stats);
+
+#endif /* IS_ENABLED(CONFIG_SHELL) */
+
+static int send_keyboard_report_to(struct zmk_endpoint_instance endpoint) {
     struct zmk_hid_keyboard_report *keyboard_report = zmk_hid_get_keyboard_report();
+    struct endpoint_report_state *state = get_report_state(endpoint);
 
-    switch (current_instance.transport) {
+    if (keyboard_report_is_duplicate(state, keyboard_report)) {
+        LOG_DBG("Keyboard report unchanged, not sending");
+        atomic_inc(&state->suppressed);
+        return 0;
+    }
+
+    switch (endpoint.transport) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
     case ZMK_TRANSPORT_USB: {
         int err = zmk_usb_hid_send_report((uint8_t *)keyboard_report, sizeof(*keyboard_report));
         if (err) {
             LOG_ERR("FAILED TO SEND OVER USB: %d", err);
+        } else {
+            keyboard_report_sent(state, keyboard_report);
+            zmk_latency_trace_report_sent();
         }
         return err;
     }
@@ -137,25 +293,38 @@ static int send_keyboard_report(void) {
         int err = zmk_hog_send_keyboard_report(&keyboard_report->body);
         if (err) {
             LOG_ERR("FAILED TO SEND OVER HOG: %d", err);
+        } else {
+            keyboard_report_sent(state, keyboard_report);
+            zmk_latency_trace_report_sent();
         }
         return err;
     }
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
     }
 
-    LOG_ERR("Unsupported endpoint transport %d", current_instance.transport);
+    LOG_ERR("Unsupported endpoint transport %d", endpoint.transport);
     return -ENOTSUP;
 }
 
-static int send_consumer_report(void) {
+static int send_consumer_report_to(struct zmk_endpoint_instance endpoint) {
     struct zmk_hid_consumer_report *consumer_report = zmk_hid_get_consumer_report();
+    struct endpoint_report_state *state = get_report_state(endpoint);
 
-    switch (current_instance.transport) {
+    if (consumer_report_is_duplicate(state, consumer_report)) {
+        LOG_DBG("Consumer report unchanged, not sending");
+        atomic_inc(&state->suppressed);
+        return 0;
+    }
+
+    switch (endpoint.transport) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
     case ZMK_TRANSPORT_USB: {
         int err = zmk_usb_hid_send_report((uint8_t *)consumer_report, sizeof(*consumer_report));
         if (err) {
             LOG_ERR("FAILED TO SEND OVER USB: %d", err);
+        } else {
+            consumer_report_sent(state, consumer_report);
+            zmk_latency_trace_report_sent();
         }
         return err;
     }
@@ -166,19 +335,131 @@ static int send_consumer_report(void) {
         int err = zmk_hog_send_consumer_report(&consumer_report->body);
         if (err) {
             LOG_ERR("FAILED TO SEND OVER HOG: %d", err);
+        } else {
+            consumer_report_sent(state, consumer_report);
+            zmk_latency_trace_report_sent();
         }
         return err;
     }
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
     }
 
-    LOG_ERR("Unsupported endpoint transport %d", current_instance.transport);
+    LOG_ERR("Unsupported endpoint transport %d", endpoint.transport);
     return -ENOTSUP;
 }
 
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINTS_MIRROR)
+
+#define MAX_REPORT_ENDPOINTS 2
+
+// Every ready endpoint gets the reports. USB goes first, and each endpoint queues its reports on
+// its own, so a slow BLE link never holds up USB.
+static int get_report_endpoints(struct zmk_endpoint_instance *endpoints) {
+    int count = 0;
+
+    if (is_usb_ready()) {
+        endpoints[count++] = (struct zmk_endpoint_instance){.transport = ZMK_TRANSPORT_USB};
+    }
+
+    if (is_ble_ready()) {
+        endpoints[count++] = (struct zmk_endpoint_instance){
+            .transport = ZMK_TRANSPORT_BLE, .ble.profile_index = zmk_ble_active_profile_index()};
+    }
+
+    if (count == 0) {
+        endpoints[count++] = current_instance;
+    }
+
+    return count;
+}
+
+#else
+
+#define MAX_REPORT_ENDPOINTS 1
+
+static int get_report_endpoints(struct zmk_endpoint_instance *endpoints) {
+    endpoints[0] = current_instance;
+    return 1;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_ENDPOINTS_MIRROR) */
+
+static int send_to_report_endpoints(int (*send_to)(struct zmk_endpoint_instance endpoint)) {
+    struct zmk_endpoint_instance endpoints[MAX_REPORT_ENDPOINTS];
+    int count = get_report_endpoints(endpoints);
+    int ret = 0;
+
+    for (int i = 0; i < count; i++) {
+        int err = send_to(endpoints[i]);
+        ret = ret ? ret : err;
+    }
+
+    return ret;
+}
+
+static int send_keyboard_report(void) { return send_to_report_endpoints(send_keyboard_report_to); }
+
+static int send_consumer_report(void) { return send_to_report_endpoints(send_consumer_report_to); }
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+
+static uint8_t batch_depth;
+static bool keyboard_report_pending;
+static bool consumer_report_pending;
+
+void zmk_endpoints_batch_begin(void) { batch_depth++; }
+
+int zmk_endpoints_flush_reports(void) {
+    int ret = 0;
+
+    if (keyboard_report_pending) {
+        LOG_DBG("Sending pending keyboard report, modifiers 0x%02X",
+                zmk_hid_get_keyboard_report()->body.modifiers);
+        keyboard_report_pending = false;
+        ret = send_keyboard_report();
+    }
+
+    if (consumer_report_pending) {
+        consumer_report_pending = false;
+        int err = send_consumer_report();
+        ret = ret ? ret : err;
+    }
+
+    zmk_latency_trace_reports_flushed();
+
+    return ret;
+}
+
+int zmk_endpoints_batch_end(void) {
+    if (batch_depth == 0 || --batch_depth > 0) {
+        return 0;
+    }
+
+    return zmk_endpoints_flush_reports();
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS) */
+
 int zmk_endpoints_send_report(uint16_t usage_page) {
 
     LOG_DBG("usage page 0x%02X", usage_page);
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+    if (batch_depth > 0) {
+        switch (usage_page) {
+        case HID_USAGE_KEY:
+            keyboard_report_pending = true;
+            zmk_latency_trace_report_deferred();
+            return 0;
+
+        case HID_USAGE_CONSUMER:
+            consumer_report_pending = true;
+            zmk_latency_trace_report_deferred();
+            return 0;
+        }
+    }
+#endif /* IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS) */
+
     switch (usage_page) {
     case HID_USAGE_KEY:
         return send_keyboard_report();
@@ -192,10 +473,10 @@ int zmk_endpoints_send_report(uint16_t usage_page) {
 }
 
 #if IS_ENABLED(CONFIG_ZMK_MOUSE)
-int zmk_endpoints_send_mouse_report() {
+static int send_mouse_report_to(struct zmk_endpoint_instance endpoint) {
     struct zmk_hid_mouse_report *mouse_report = zmk_hid_get_mouse_report();
 
-    switch (current_instance.transport) {
+    switch (endpoint.transport) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
     case ZMK_TRANSPORT_USB: {
         int err = zmk_usb_hid_send_report((uint8_t *)mouse_report, sizeof(*mouse_report));
@@ -217,10 +498,12 @@ int zmk_endpoints_send_mouse_report() {
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
 
     default:
-        LOG_ERR("Unsupported endpoint %d", current_instance.transport);
+        LOG_ERR("Unsupported endpoint %d", endpoint.transport);
         return -ENOTSUP;
     }
 }
+
+int zmk_endpoints_send_mouse_report() { return send_to_report_endpoints(send_mouse_report_to); }
 #endif /* IS_ENABLED(CONFIG_ZMK_MOUSE) */
 
 #if IS_ENABLED(CONFIG_SETTINGS)
@@ -354,6 +637,7 @@ static void update_current_endpoint(void) {
 }
 
 static int endpoint_listener(const zmk_event_t *eh) {
+    invalidate_report_states();
     update_current_endpoint();
     return 0;
 }
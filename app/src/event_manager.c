@@ -5,11 +5,14 @@
  */
 
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/printk.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/event_manager.h>
+#include <zmk/latency_trace.h>
 
 extern struct zmk_event_type *__event_type_start[];
 extern struct zmk_event_type *__event_type_end[];
@@ -17,16 +20,142 @@ extern struct zmk_event_type *__event_type_end[];
 extern struct zmk_event_subscription __event_subscriptions_start[];
 extern struct zmk_event_subscription __event_subscriptions_end[];
 
+static void record_pool_high_water(struct zmk_event_pool_stats *stats, atomic_val_t used) {
+    atomic_val_t high_water;
+    do {
+        high_water = atomic_get(&stats->high_water);
+        if (used <= high_water) {
+            return;
+        }
+    } while (!atomic_cas(&stats->high_water, high_water, used));
+}
+
+void *zmk_event_manager_alloc(const struct zmk_event_type *type) {
+    void *ev;
+    if (k_mem_slab_alloc(type->pool, &ev, K_NO_WAIT) != 0) {
+        atomic_val_t failures = atomic_inc(&type->pool_stats->failures) + 1;
+        LOG_ERR("Event pool for %s exhausted (%ld failures)", type->name, (long)failures);
+        return NULL;
+    }
+
+    record_pool_high_water(type->pool_stats, k_mem_slab_num_used_get(type->pool));
+
+    return ev;
+}
+
+void zmk_event_manager_free(zmk_event_t *event) {
+    void *ev = event;
+    k_mem_slab_free(event->event->pool, &ev);
+}
+
+void zmk_event_manager_print_pool_stats(void) {
+    printk("%-36s %6s %6s %10s %8s\n", "event", "used", "size", "high water", "failures");
+    for (struct zmk_event_type **type = __event_type_start; type < __event_type_end; type++) {
+        printk("%-36s %6u %6u %10ld %8ld\n", (*type)->name, k_mem_slab_num_used_get((*type)->pool),
+               (*type)->pool->num_blocks, (long)atomic_get(&(*type)->pool_stats->high_water),
+               (long)atomic_get(&(*type)->pool_stats->failures));
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING)
+
+static void record_listener_stats(struct zmk_listener_stats *stats, uint32_t cycles, int ret) {
+    stats->calls++;
+    stats->total_cycles += cycles;
+    stats->worst_cycles = MAX(stats->worst_cycles, cycles);
+    stats->results[(ret >= 0 && ret < ZMK_LISTENER_STATS_RESULTS - 1)
+                       ? ret
+                       : ZMK_LISTENER_STATS_RESULTS - 1]++;
+}
+
+// Sorted by total cycles spent, descending. Cycles include any events raised from inside the
+// listener, so nested listeners are counted more than once.
+void zmk_event_manager_print_listener_stats(void) {
+    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
+    uint64_t last_total = UINT64_MAX;
+    int last_index = -1;
+
+    printk("%-24s %-36s %8s %10s %8s %8s %8s %8s %8s\n", "listener", "event", "calls", "total us",
+           "worst us", "bubble", "handled", "capture", "error");
+    for (int n = 0; n < len; n++) {
+        int next = -1;
+        for (int i = 0; i < len; i++) {
+            uint64_t total = __event_subscriptions_start[i].stats->total_cycles;
+            bool after_last = total < last_total || (total == last_total && i > last_index);
+            if (after_last &&
+                (next < 0 || total > __event_subscriptions_start[next].stats->total_cycles)) {
+                next = i;
+            }
+        }
+
+        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + next;
+        struct zmk_listener_stats *stats = ev_sub->stats;
+        printk("%-24s %-36s %8u %10u %8u %8u %8u %8u %8u\n", ev_sub->listener->name,
+               ev_sub->event_type->name, stats->calls,
+               (uint32_t)k_cyc_to_us_floor64(stats->total_cycles),
+               k_cyc_to_us_floor32(stats->worst_cycles), stats->results[ZMK_EV_EVENT_BUBBLE],
+               stats->results[ZMK_EV_EVENT_HANDLED], stats->results[ZMK_EV_EVENT_CAPTURED],
+               stats->results[ZMK_LISTENER_STATS_RESULTS - 1]);
+
+        last_total = stats->total_cycles;
+        last_index = next;
+    }
+}
+
+#if IS_ENABLED(CONFIG_BOARD_NATIVE_POSIX) || IS_ENABLED(CONFIG_BOARD_NATIVE_POSIX_64BIT)
+
+#include <soc.h>
+
+NATIVE_TASK(zmk_event_manager_print_pool_stats, ON_EXIT, 2);
+NATIVE_TASK(zmk_event_manager_print_listener_stats, ON_EXIT, 3);
+
+#endif
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING) */
+
+#if IS_ENABLED(CONFIG_SHELL)
+
+#include <zephyr/shell/shell.h>
+
+static int cmd_pool_stats(const struct shell *sh, size_t argc, char **argv) {
+    zmk_event_manager_print_pool_stats();
+    return 0;
+}
+
+SHELL_CMD_REGISTER(zmk_event_pools, NULL, "Print event pool usage", cmd_pool_stats);
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING)
+
+static int cmd_listener_stats(const struct shell *sh, size_t argc, char **argv) {
+    zmk_event_manager_print_listener_stats();
+    return 0;
+}
+
+SHELL_CMD_REGISTER(zmk_listeners, NULL, "Print event listener profiling counters",
+                   cmd_listener_stats);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING) */
+
+#endif /* IS_ENABLED(CONFIG_SHELL) */
+
 int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     int ret = 0;
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = start_index; i < len; i++) {
+    const struct zmk_event_dispatch *dispatch = event->event->dispatch;
+    uint8_t end = dispatch->first + dispatch->count;
+    for (int i = MAX(start_index, dispatch->first); i < end; i++) {
         struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
-        if (ev_sub->event_type != event->event) {
+        if (*ev_sub->listener->disabled) {
             continue;
         }
         event->last_listener_index = i;
+        zmk_latency_trace_listener_hop(event, ev_sub->listener);
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_PROFILING)
+        uint32_t start = k_cycle_get_32();
         ret = ev_sub->listener->callback(event);
+        record_listener_stats(ev_sub->stats, k_cycle_get_32() - start, ret);
+#else
+        ret = ev_sub->listener->callback(event);
+#endif
         switch (ret) {
         case ZMK_EV_EVENT_BUBBLE:
             continue;
@@ -45,42 +174,113 @@ int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     }
 
 release:
-    k_free(event);
+    zmk_event_manager_free(event);
     return ret;
 }
 
-int zmk_event_manager_raise(zmk_event_t *event) { return zmk_event_manager_handle_from(event, 0); }
+void zmk_event_manager_listener_enable(const struct zmk_listener *listener) {
+    *listener->disabled = false;
+}
 
-int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
+void zmk_event_manager_listener_disable(const struct zmk_listener *listener) {
+    *listener->disabled = true;
+}
+
+bool zmk_event_manager_listener_is_enabled(const struct zmk_listener *listener) {
+    return !*listener->disabled;
+}
+
+#define NO_SUBSCRIPTION UINT8_MAX
+
+static uint8_t subscription_bucket(const struct zmk_event_type *type,
+                                   const struct zmk_listener *listener, uint8_t len) {
+    uintptr_t key = ((uintptr_t)type >> 2) * 31 + ((uintptr_t)listener >> 2);
+    return (key ^ (key >> 8)) % len;
+}
+
+static int find_listener_index(const zmk_event_t *event, const struct zmk_listener *listener) {
     uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+    if (len == 0) {
+        return -EINVAL;
+    }
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i + 1);
+    uint8_t bucket = subscription_bucket(event->event, listener, len);
+    for (uint8_t i = __event_subscriptions_start[bucket].slot->bucket; i != NO_SUBSCRIPTION;
+         i = __event_subscriptions_start[i].slot->next) {
+        if (__event_subscriptions_start[i].event_type == event->event &&
+            __event_subscriptions_start[i].listener == listener) {
+            return i;
         }
     }
 
-    LOG_WRN("Unable to find where to raise this after event");
-
     return -EINVAL;
 }
 
+int zmk_event_manager_raise(zmk_event_t *event) {
+    if (event == NULL) {
+        return -ENOMEM;
+    }
+
+    return zmk_event_manager_handle_from(event, event->event->dispatch->first);
+}
+
+int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
+    if (event == NULL) {
+        return -ENOMEM;
+    }
+
+    int index = find_listener_index(event, listener);
+    if (index < 0) {
+        LOG_WRN("Unable to find where to raise this after event");
+        return index;
+    }
+
+    return zmk_event_manager_handle_from(event, index + 1);
+}
+
 int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener) {
+    if (event == NULL) {
+        return -ENOMEM;
+    }
+
+    int index = find_listener_index(event, listener);
+    if (index < 0) {
+        LOG_WRN("Unable to find where to raise this event");
+        return index;
+    }
+
+    return zmk_event_manager_handle_from(event, index);
+}
+
+int zmk_event_manager_release(zmk_event_t *event) {
+    return zmk_event_manager_handle_from(event, event->last_listener_index + 1);
+}
+
+static int event_manager_init(const struct device *_arg) {
     uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
+    __ASSERT(__event_subscriptions_end - __event_subscriptions_start < NO_SUBSCRIPTION,
+             "Too many event subscriptions");
+
+    for (int i = 0; i < len; i++) {
+        __event_subscriptions_start[i].slot->bucket = NO_SUBSCRIPTION;
+    }
+
     for (int i = 0; i < len; i++) {
         struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+        uint8_t bucket = subscription_bucket(ev_sub->event_type, ev_sub->listener, len);
+        ev_sub->slot->next = __event_subscriptions_start[bucket].slot->bucket;
+        __event_subscriptions_start[bucket].slot->bucket = i;
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i);
+        struct zmk_event_dispatch *dispatch = ev_sub->event_type->dispatch;
+        if (dispatch->count == 0) {
+            dispatch->first = i;
         }
+        __ASSERT(dispatch->first + dispatch->count == i, "Subscriptions for %s are not contiguous",
+                 ev_sub->event_type->name);
+        dispatch->count++;
     }
 
-    LOG_WRN("Unable to find where to raise this event");
-
-    return -EINVAL;
+    return 0;
 }
 
-int zmk_event_manager_release(zmk_event_t *event) {
-    return zmk_event_manager_handle_from(event, event->last_listener_index + 1);
-}
+SYS_INIT(event_manager_init, PRE_KERNEL_1, 0);
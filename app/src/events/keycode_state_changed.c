@@ -7,4 +7,5 @@
 #include <zephyr/kernel.h>
 #include <zmk/events/keycode_state_changed.h>
 
-ZMK_EVENT_IMPL(zmk_keycode_state_changed);
+ZMK_EVENT_IMPL_POOL(zmk_keycode_state_changed,
+                    CONFIG_ZMK_EVENT_POOL_SIZE_KEYCODE_STATE_CHANGED);
@@ -7,4 +7,5 @@
 #include <zephyr/kernel.h>
 #include <zmk/events/position_state_changed.h>
 
-ZMK_EVENT_IMPL(zmk_position_state_changed);
\ No newline at end of file
+ZMK_EVENT_IMPL_POOL(zmk_position_state_changed,
+                    CONFIG_ZMK_EVENT_POOL_SIZE_POSITION_STATE_CHANGED);
\ No newline at end of file
@@ -12,13 +12,16 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <dt-bindings/zmk/modifiers.h>
 
 static struct zmk_hid_keyboard_report keyboard_report = {
-    .report_id = 1, .body = {.modifiers = 0, ._reserved = 0, .keys = {0}}};
+    .report_id = ZMK_HID_REPORT_ID_KEYBOARD,
+    .body = {.modifiers = 0, ._reserved = 0, .keys = {0}}};
 
-static struct zmk_hid_consumer_report consumer_report = {.report_id = 2, .body = {.keys = {0}}};
+static struct zmk_hid_consumer_report consumer_report = {.report_id = ZMK_HID_REPORT_ID_CONSUMER,
+                                                         .body = {.keys = {0}}};
 
 #if IS_ENABLED(CONFIG_ZMK_MOUSE)
 static struct zmk_hid_mouse_report mouse_report = {
-    .report_id = 4, .body = {.buttons = 0, .x = 0, .y = 0, .scroll_x = 0, .scroll_y = 0}};
+    .report_id = ZMK_HID_REPORT_ID_MOUSE,
+    .body = {.buttons = 0, .x = 0, .y = 0, .scroll_x = 0, .scroll_y = 0}};
 #endif
 
 // Keep track of how often a modifier was pressed.
@@ -28,9 +31,17 @@ static zmk_mod_flags_t explicit_modifiers = 0;
 static zmk_mod_flags_t implicit_modifiers = 0;
 static zmk_mod_flags_t masked_modifiers = 0;
 
+// Bumped whenever the report body changes, see zmk_hid_*_report_generation
+static uint32_t keyboard_report_generation;
+static uint32_t consumer_report_generation;
+
 #define SET_MODIFIERS(mods)                                                                        \
     {                                                                                              \
-        keyboard_report.body.modifiers = (mods & ~masked_modifiers) | implicit_modifiers;          \
+        zmk_mod_flags_t new_modifiers = (mods & ~masked_modifiers) | implicit_modifiers;           \
+        if (keyboard_report.body.modifiers != new_modifiers) {                                     \
+            keyboard_report.body.modifiers = new_modifiers;                                        \
+            keyboard_report_generation++;                                                          \
+        }                                                                                          \
         LOG_DBG("Modifiers set to 0x%02X", keyboard_report.body.modifiers);                        \
     }
 
@@ -38,6 +49,8 @@ static zmk_mod_flags_t masked_modifiers = 0;
 
 zmk_mod_flags_t zmk_hid_get_explicit_mods() { return explicit_modifiers; }
 
+zmk_mod_flags_t zmk_hid_get_implicit_mods() { return implicit_modifiers; }
+
 int zmk_hid_register_mod(zmk_mod_t modifier) {
     explicit_modifier_counts[modifier]++;
     LOG_DBG("Modifier %d count %d", modifier, explicit_modifier_counts[modifier]);
@@ -91,7 +104,14 @@ int zmk_hid_unregister_mods(zmk_mod_flags_t modifiers) {
 
 #if IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO)
 
-#define TOGGLE_KEYBOARD(code, val) WRITE_BIT(keyboard_report.body.keys[code / 8], code % 8, val)
+#define TOGGLE_KEYBOARD(code, val)                                                                 \
+    {                                                                                              \
+        uint8_t keys = keyboard_report.body.keys[code / 8];                                        \
+        WRITE_BIT(keyboard_report.body.keys[code / 8], code % 8, val);                             \
+        if (keyboard_report.body.keys[code / 8] != keys) {                                         \
+            keyboard_report_generation++;                                                          \
+        }                                                                                          \
+    }
 
 static inline int select_keyboard_usage(zmk_key_t usage) {
     if (usage > ZMK_HID_KEYBOARD_NKRO_MAX_USAGE) {
@@ -124,6 +144,7 @@ static inline bool check_keyboard_usage(zmk_key_t usage) {
             continue;                                                                              \
         }                                                                                          \
         keyboard_report.body.keys[idx] = val;                                                      \
+        keyboard_report_generation++;                                                              \
         if (val) {                                                                                 \
             break;                                                                                 \
         }                                                                                          \
@@ -160,6 +181,7 @@ static inline int check_keyboard_usage(zmk_key_t usage) {
             continue;                                                                              \
         }                                                                                          \
         consumer_report.body.keys[idx] = val;                                                      \
+        consumer_report_generation++;                                                              \
         if (val) {                                                                                 \
             break;                                                                                 \
         }                                                                                          \
@@ -216,7 +238,10 @@ bool zmk_hid_keyboard_is_pressed(zmk_key_t code) {
     return check_keyboard_usage(code);
 }
 
-void zmk_hid_keyboard_clear() { memset(&keyboard_report.body, 0, sizeof(keyboard_report.body)); }
+void zmk_hid_keyboard_clear() {
+    memset(&keyboard_report.body, 0, sizeof(keyboard_report.body));
+    keyboard_report_generation++;
+}
 
 int zmk_hid_consumer_press(zmk_key_t code) {
     TOGGLE_CONSUMER(0U, code);
@@ -228,7 +253,10 @@ int zmk_hid_consumer_release(zmk_key_t code) {
     return 0;
 };
 
-void zmk_hid_consumer_clear() { memset(&consumer_report.body, 0, sizeof(consumer_report.body)); }
+void zmk_hid_consumer_clear() {
+    memset(&consumer_report.body, 0, sizeof(consumer_report.body));
+    consumer_report_generation++;
+}
 
 bool zmk_hid_consumer_is_pressed(zmk_key_t key) {
     for (int idx = 0; idx < CONFIG_ZMK_HID_CONSUMER_REPORT_SIZE; idx++) {
@@ -354,10 +382,14 @@ struct zmk_hid_keyboard_report *zmk_hid_get_keyboard_report() {
     return &keyboard_report;
 }
 
+uint32_t zmk_hid_keyboard_report_generation() { return keyboard_report_generation; }
+
 struct zmk_hid_consumer_report *zmk_hid_get_consumer_report() {
     return &consumer_report;
 }
 
+uint32_t zmk_hid_consumer_report_generation() { return consumer_report_generation; }
+
 #if IS_ENABLED(CONFIG_ZMK_MOUSE)
 struct zmk_hid_mouse_report *zmk_hid_get_mouse_report() {
     return &mouse_report;
@@ -16,6 +16,18 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <dt-bindings/zmk/hid_usage_pages.h>
 #include <zmk/endpoints.h>
 
+// Reports coalesced during a kscan batch must reach the host before anything is released or the
+// modifiers change, or a key pressed earlier in the same batch would be lost or sent with the
+// wrong modifiers.
+static void flush_pending_reports(void) {
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+    int err = zmk_endpoints_flush_reports();
+    if (err < 0) {
+        LOG_ERR("Failed to flush pending reports (%d)", err);
+    }
+#endif
+}
+
 static int hid_listener_keycode_pressed(const struct zmk_keycode_state_changed *ev) {
     int err, explicit_mods_changed, implicit_mods_changed;
 
@@ -23,6 +35,7 @@ static int hid_listener_keycode_pressed(const struct zmk_keycode_state_changed *
         zmk_hid_is_pressed(ZMK_HID_USAGE(ev->usage_page, ev->keycode))) {
         LOG_DBG("unregistering usage_page 0x%02X keycode 0x%02X since it was already pressed",
                 ev->usage_page, ev->keycode);
+        flush_pending_reports();
         err = zmk_hid_release(ZMK_HID_USAGE(ev->usage_page, ev->keycode));
         if (err < 0) {
             LOG_DBG("Unable to pre-release keycode (%d)", err);
@@ -36,6 +49,12 @@ static int hid_listener_keycode_pressed(const struct zmk_keycode_state_changed *
 
     LOG_DBG("usage_page 0x%02X keycode 0x%02X implicit_mods 0x%02X explicit_mods 0x%02X",
             ev->usage_page, ev->keycode, ev->implicit_modifiers, ev->explicit_modifiers);
+    // Modifiers apply to every key in the report, so keys pressed earlier in the batch have to
+    // reach the host before they change, e.g. LS(A) followed by B must not type "ab".
+    if (ev->implicit_modifiers != zmk_hid_get_implicit_mods() ||
+        (ev->explicit_modifiers & ~zmk_hid_get_explicit_mods()) != 0) {
+        flush_pending_reports();
+    }
     err = zmk_hid_press(ZMK_HID_USAGE(ev->usage_page, ev->keycode));
     if (err < 0) {
         LOG_DBG("Unable to press keycode");
@@ -60,6 +79,7 @@ static int hid_listener_keycode_released(const struct zmk_keycode_state_changed
 
     LOG_DBG("usage_page 0x%02X keycode 0x%02X implicit_mods 0x%02X explicit_mods 0x%02X",
             ev->usage_page, ev->keycode, ev->implicit_modifiers, ev->explicit_modifiers);
+    flush_pending_reports();
     err = zmk_hid_release(ZMK_HID_USAGE(ev->usage_page, ev->keycode));
     if (err < 0) {
         LOG_DBG("Unable to release keycode");
@@ -6,6 +6,7 @@
 
 #include <zephyr/settings/settings.h>
 #include <zephyr/init.h>
+#include <zephyr/spinlock.h>
 
 #include <zephyr/logging/log.h>
 
@@ -186,103 +187,120 @@ K_THREAD_STACK_DEFINE(hog_q_stack, CONFIG_ZMK_BLE_THREAD_STACK_SIZE);
 
 struct k_work_q hog_work_q;
 
-K_MSGQ_DEFINE(zmk_hog_keyboard_msgq, sizeof(struct zmk_hid_keyboard_report_body),
-              CONFIG_ZMK_BLE_KEYBOARD_REPORT_QUEUE_SIZE, 4);
+// Reports waiting to be notified. The input path never waits for room: once the queue is full, the
+// newest pending report is overwritten with the latest state. Reports are notified straight from
+// their slot, so a slot is only reused once its report has been notified.
+struct hog_report_queue {
+    struct k_spinlock lock;
+    uint8_t *reports;
+    size_t report_size;
+    uint32_t capacity;
+    // Free running sequence numbers, reports [head, tail) are pending and head is notified next
+    uint32_t head;
+    uint32_t tail;
+};
 
-void send_keyboard_report_callback(struct k_work *work) {
-    struct zmk_hid_keyboard_report_body report;
+// At least two slots, so the newest pending report is never the one being notified when full
+#define HOG_REPORT_QUEUE_DEFINE(name, type, size)                                                  \
+    static uint8_t name##_reports[MAX(size, 2)][sizeof(type)];                                     \
+    static struct hog_report_queue name = {                                                        \
+        .reports = (uint8_t *)name##_reports,                                                      \
+        .report_size = sizeof(type),                                                               \
+        .capacity = MAX(size, 2),                                                                  \
+    }
 
-    while (k_msgq_get(&zmk_hog_keyboard_msgq, &report, K_NO_WAIT) == 0) {
-        struct bt_conn *conn = destination_connection();
-        if (conn == NULL) {
-            return;
-        }
+static uint8_t *report_slot(struct hog_report_queue *queue, uint32_t seq) {
+    return queue->reports + (seq % queue->capacity) * queue->report_size;
+}
+
+// Returns false if the report is the same as the newest pending one and was not queued.
+static bool queue_report(struct hog_report_queue *queue, const void *report) {
+    bool queued = true;
+    k_spinlock_key_t key = k_spin_lock(&queue->lock);
+
+    if (queue->tail != queue->head &&
+        memcmp(report_slot(queue, queue->tail - 1), report, queue->report_size) == 0) {
+        queued = false;
+    } else if (queue->tail - queue->head < queue->capacity) {
+        memcpy(report_slot(queue, queue->tail), report, queue->report_size);
+        queue->tail++;
+    } else {
+        LOG_DBG("Report queue full, replacing newest pending report");
+        memcpy(report_slot(queue, queue->tail - 1), report, queue->report_size);
+    }
+
+    k_spin_unlock(&queue->lock, key);
+    return queued;
+}
+
+// Failed notifications are logged as errors if log_errors is set, otherwise only at debug level.
+static void notify_reports(struct hog_report_queue *queue, const struct bt_gatt_attr *attr,
+                           bool log_errors) {
+    struct bt_conn *conn = destination_connection();
+    k_spinlock_key_t key = k_spin_lock(&queue->lock);
+
+    if (conn == NULL) {
+        queue->head = queue->tail;
+        k_spin_unlock(&queue->lock, key);
+        return;
+    }
+
+    while (queue->head != queue->tail) {
+        uint32_t seq = queue->head;
+        k_spin_unlock(&queue->lock, key);
 
         struct bt_gatt_notify_params notify_params = {
-            .attr = &hog_svc.attrs[5],
-            .data = &report,
-            .len = sizeof(report),
+            .attr = attr,
+            .data = report_slot(queue, seq),
+            .len = queue->report_size,
         };
 
         int err = bt_gatt_notify_cb(conn, &notify_params);
-        if (err) {
+        if (err && log_errors) {
             LOG_ERR("Error notifying %d", err);
+        } else if (err) {
+            LOG_DBG("Error notifying %d", err);
         }
 
-        bt_conn_unref(conn);
+        key = k_spin_lock(&queue->lock);
+        queue->head++;
     }
+
+    k_spin_unlock(&queue->lock, key);
+    bt_conn_unref(conn);
+}
+
+HOG_REPORT_QUEUE_DEFINE(keyboard_queue, struct zmk_hid_keyboard_report_body,
+                        CONFIG_ZMK_BLE_KEYBOARD_REPORT_QUEUE_SIZE);
+
+void send_keyboard_report_callback(struct k_work *work) {
+    notify_reports(&keyboard_queue, &hog_svc.attrs[5], true);
 }
 
 K_WORK_DEFINE(hog_keyboard_work, send_keyboard_report_callback);
 
 int zmk_hog_send_keyboard_report(struct zmk_hid_keyboard_report_body *report) {
-    int err = k_msgq_put(&zmk_hog_keyboard_msgq, report, K_MSEC(100));
-    if (err) {
-        switch (err) {
-        case -EAGAIN: {
-            LOG_WRN("Keyboard message queue full, popping first message and queueing again");
-            struct zmk_hid_keyboard_report_body discarded_report;
-            k_msgq_get(&zmk_hog_keyboard_msgq, &discarded_report, K_NO_WAIT);
-            return zmk_hog_send_keyboard_report(report);
-        }
-        default:
-            LOG_WRN("Failed to queue keyboard report to send (%d)", err);
-            return err;
-        }
+    if (queue_report(&keyboard_queue, report)) {
+        k_work_submit_to_queue(&hog_work_q, &hog_keyboard_work);
     }
 
-    k_work_submit_to_queue(&hog_work_q, &hog_keyboard_work);
-
     return 0;
 };
 
-K_MSGQ_DEFINE(zmk_hog_consumer_msgq, sizeof(struct zmk_hid_consumer_report_body),
-              CONFIG_ZMK_BLE_CONSUMER_REPORT_QUEUE_SIZE, 4);
+HOG_REPORT_QUEUE_DEFINE(consumer_queue, struct zmk_hid_consumer_report_body,
+                        CONFIG_ZMK_BLE_CONSUMER_REPORT_QUEUE_SIZE);
 
 void send_consumer_report_callback(struct k_work *work) {
-    struct zmk_hid_consumer_report_body report;
-
-    while (k_msgq_get(&zmk_hog_consumer_msgq, &report, K_NO_WAIT) == 0) {
-        struct bt_conn *conn = destination_connection();
-        if (conn == NULL) {
-            return;
-        }
-
-        struct bt_gatt_notify_params notify_params = {
-            .attr = &hog_svc.attrs[10],
-            .data = &report,
-            .len = sizeof(report),
-        };
-
-        int err = bt_gatt_notify_cb(conn, &notify_params);
-        if (err) {
-            LOG_DBG("Error notifying %d", err);
-        }
-
-        bt_conn_unref(conn);
-    }
+    notify_reports(&consumer_queue, &hog_svc.attrs[10], false);
 };
 
 K_WORK_DEFINE(hog_consumer_work, send_consumer_report_callback);
 
 int zmk_hog_send_consumer_report(struct zmk_hid_consumer_report_body *report) {
-    int err = k_msgq_put(&zmk_hog_consumer_msgq, report, K_MSEC(100));
-    if (err) {
-        switch (err) {
-        case -EAGAIN: {
-            LOG_WRN("Consumer message queue full, popping first message and queueing again");
-            struct zmk_hid_consumer_report_body discarded_report;
-            k_msgq_get(&zmk_hog_consumer_msgq, &discarded_report, K_NO_WAIT);
-            return zmk_hog_send_consumer_report(report);
-        }
-        default:
-            LOG_WRN("Failed to queue consumer report to send (%d)", err);
-            return err;
-        }
+    if (queue_report(&consumer_queue, report)) {
+        k_work_submit_to_queue(&hog_work_q, &hog_consumer_work);
     }
 
-    k_work_submit_to_queue(&hog_work_q, &hog_consumer_work);
-
     return 0;
 };
 
@@ -5,6 +5,7 @@
  */
 
 #include <drivers/behavior.h>
+#include <zephyr/init.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/logging/log.h>
@@ -22,6 +23,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #endif
 
 #include <zmk/event_manager.h>
+#include <zmk/latency_trace.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/layer_state_changed.h>
 #include <zmk/events/sensor_event.h>
@@ -79,6 +81,47 @@ static struct zmk_behavior_binding zmk_sensor_keymap[ZMK_KEYMAP_LAYERS_LEN]
 
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_transparent)
+#define TRANSPARENT_BEHAVIOR DEVICE_DT_GET(DT_INST(0, zmk_behavior_transparent))
+#else
+#define TRANSPARENT_BEHAVIOR NULL
+#endif
+
+// For the current layer state, the highest active layer at each position whose binding doesn't
+// always fall through to the next layer (&trans or no behavior). Key presses start from there
+// instead of walking every layer above it.
+static uint8_t zmk_keymap_effective_layer[ZMK_KEYMAP_LEN];
+
+static inline bool binding_falls_through(uint8_t layer, uint32_t position) {
+    const struct device *behavior = zmk_keymap[layer][position].behavior;
+    return behavior == NULL || behavior == TRANSPARENT_BEHAVIOR;
+}
+
+static uint8_t find_effective_layer(uint32_t position, int from_layer) {
+    for (int layer = from_layer; layer > _zmk_keymap_layer_default; layer--) {
+        if (zmk_keymap_layer_active_with_state(layer, _zmk_keymap_layer_state) &&
+            !binding_falls_through(layer, position)) {
+            return layer;
+        }
+    }
+
+    return _zmk_keymap_layer_default;
+}
+
+// Only positions the changed layer can affect need updating
+static void update_effective_layers(uint8_t layer, bool state) {
+    for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+        if (state) {
+            if (layer > zmk_keymap_effective_layer[position] &&
+                !binding_falls_through(layer, position)) {
+                zmk_keymap_effective_layer[position] = layer;
+            }
+        } else if (layer == zmk_keymap_effective_layer[position]) {
+            zmk_keymap_effective_layer[position] = find_effective_layer(position, layer - 1);
+        }
+    }
+}
+
 static inline int set_layer_state(uint8_t layer, bool state, bool momentary) {
     if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
         return -EINVAL;
@@ -94,6 +137,7 @@ static inline int set_layer_state(uint8_t layer, bool state, bool momentary) {
     // Don't send state changes unless there was an actual change
     if (old_state != _zmk_keymap_layer_state) {
         LOG_DBG("layer_changed: layer %d state %d", layer, state);
+        update_effective_layers(layer, state);
         WRITE_BIT(_zmk_keymap_layer_momentary, layer, momentary);
         ZMK_EVENT_RAISE(create_layer_state_changed(layer, state));
     }
@@ -192,7 +236,7 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
 
     LOG_DBG("layer: %d position: %d, binding name: %s", layer, position, binding.behavior_dev);
 
-    behavior = device_get_binding(binding.behavior_dev);
+    behavior = zmk_behavior_binding_get_device(&binding);
 
     if (!behavior) {
         LOG_WRN("No behavior assigned to %d on layer %d", position, layer);
@@ -242,7 +286,13 @@ int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pr
     if (pressed) {
         zmk_keymap_active_behavior_layer[position] = _zmk_keymap_layer_state;
     }
-    for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
+
+    // The cached starting layer is only valid for the current layer state, which a release may
+    // not share with its press.
+    int start_layer = zmk_keymap_active_behavior_layer[position] == _zmk_keymap_layer_state
+                          ? zmk_keymap_effective_layer[position]
+                          : ZMK_KEYMAP_LAYERS_LEN - 1;
+    for (int layer = start_layer; layer >= _zmk_keymap_layer_default; layer--) {
         if (zmk_keymap_layer_active_with_state(layer, zmk_keymap_active_behavior_layer[position])) {
             int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
             if (ret > 0) {
@@ -272,7 +322,7 @@ int zmk_keymap_sensor_event(uint8_t sensor_index,
         LOG_DBG("layer: %d sensor_index: %d, binding name: %s", layer, sensor_index,
                 binding->behavior_dev);
 
-        const struct device *behavior = device_get_binding(binding->behavior_dev);
+        const struct device *behavior = zmk_behavior_binding_get_device(binding);
         if (!behavior) {
             LOG_DBG("No behavior assigned to %d on layer %d", sensor_index, layer);
             continue;
@@ -320,8 +370,11 @@ int zmk_keymap_sensor_event(uint8_t sensor_index,
 int keymap_listener(const zmk_event_t *eh) {
     const struct zmk_position_state_changed *pos_ev;
     if ((pos_ev = as_zmk_position_state_changed(eh)) != NULL) {
-        return zmk_keymap_position_state_changed(pos_ev->source, pos_ev->position, pos_ev->state,
-                                                 pos_ev->timestamp);
+        zmk_latency_trace_keymap_begin(eh);
+        int ret = zmk_keymap_position_state_changed(pos_ev->source, pos_ev->position,
+                                                    pos_ev->state, pos_ev->timestamp);
+        zmk_latency_trace_keymap_end();
+        return ret;
     }
 
 #if ZMK_KEYMAP_HAS_SENSORS
@@ -335,6 +388,31 @@ int keymap_listener(const zmk_event_t *eh) {
     return -ENOTSUP;
 }
 
+// Resolve every binding's behavior device once, so key presses never look devices up by name.
+// Runs after the behavior drivers, which are initialized at CONFIG_KERNEL_INIT_PRIORITY_DEFAULT.
+static int zmk_keymap_init(const struct device *_arg) {
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+            zmk_behavior_binding_get_device(&zmk_keymap[layer][position]);
+        }
+
+#if ZMK_KEYMAP_HAS_SENSORS
+        for (int sensor = 0; sensor < ZMK_KEYMAP_SENSORS_LEN; sensor++) {
+            zmk_behavior_binding_get_device(&zmk_sensor_keymap[layer][sensor]);
+        }
+#endif /* ZMK_KEYMAP_HAS_SENSORS */
+    }
+
+    for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+        zmk_keymap_effective_layer[position] =
+            find_effective_layer(position, ZMK_KEYMAP_LAYERS_LEN - 1);
+    }
+
+    return 0;
+}
+
+SYS_INIT(zmk_keymap_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 ZMK_LISTENER(keymap, keymap_listener);
 ZMK_SUBSCRIPTION(keymap, zmk_position_state_changed);
 
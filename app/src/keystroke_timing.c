@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/event_manager.h>
+#include <zmk/events/keycode_state_changed.h>
+#include <zmk/keys.h>
+#include <zmk/keystroke_timing.h>
+
+#define HISTORY_SIZE CONFIG_ZMK_KEYSTROKE_TIMING_HISTORY_SIZE
+
+// The most recent keystrokes, history_next being the slot the next one is written to
+static struct zmk_keystroke history[HISTORY_SIZE];
+static uint32_t history_next;
+
+// Set time stamps to large negative numbers initially for test suites, but not int64 min since
+// adding an idle time would overflow
+static int64_t last_tap = INT32_MIN;
+static int64_t previous_tap = INT32_MIN;
+
+// A typing streak is a run of non-modifier key presses with no gap longer than the streak timeout
+static int64_t streak_started_at = INT32_MIN;
+static uint32_t streak_taps;
+
+int zmk_keystroke_timing_get(int index, struct zmk_keystroke *keystroke) {
+    if (index < 0 || index >= HISTORY_SIZE || index >= history_next) {
+        return -ENOENT;
+    }
+
+    *keystroke = history[(history_next - 1 - index) % HISTORY_SIZE];
+    return 0;
+}
+
+int64_t zmk_keystroke_timing_last_tap(void) { return last_tap; }
+
+int64_t zmk_keystroke_timing_last_tap_except(int64_t timestamp) {
+    return last_tap != timestamp ? last_tap : previous_tap;
+}
+
+int32_t zmk_keystroke_timing_average_interval(void) {
+    if (streak_taps < 2) {
+        return -1;
+    }
+    return (last_tap - streak_started_at) / (streak_taps - 1);
+}
+
+static void record_tap(int64_t timestamp) {
+    // Presses replayed after being held back may be older than the last one, those keep the
+    // timing of the presses that came after them.
+    if (timestamp <= last_tap) {
+        return;
+    }
+
+    if (timestamp - last_tap > CONFIG_ZMK_KEYSTROKE_TIMING_STREAK_TIMEOUT_MS) {
+        streak_started_at = timestamp;
+        streak_taps = 0;
+    }
+    streak_taps++;
+
+    previous_tap = last_tap;
+    last_tap = timestamp;
+}
+
+static int keystroke_timing_listener(const zmk_event_t *eh) {
+    const struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
+    if (ev == NULL) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    history[history_next % HISTORY_SIZE] = (struct zmk_keystroke){
+        .timestamp = ev->timestamp,
+        .keycode = ev->keycode,
+        .usage_page = ev->usage_page,
+        .state = ev->state,
+    };
+    history_next++;
+
+    if (ev->state && !is_mod(ev->usage_page, ev->keycode)) {
+        record_tap(ev->timestamp);
+    }
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(keystroke_timing, keystroke_timing_listener);
+ZMK_SUBSCRIPTION(keystroke_timing, zmk_keycode_state_changed);
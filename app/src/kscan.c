@@ -5,6 +5,7 @@
  */
 
 #include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/device.h>
 #include <zephyr/bluetooth/addr.h>
 #include <zephyr/drivers/kscan.h>
@@ -15,38 +16,82 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/matrix_transform.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
+#include <zmk/workqueue.h>
 
-#define ZMK_KSCAN_EVENT_STATE_PRESSED 0
-#define ZMK_KSCAN_EVENT_STATE_RELEASED 1
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+#include <zmk/endpoints.h>
+#define ZMK_KSCAN_BATCH_WINDOW K_MSEC(CONFIG_ZMK_KSCAN_COALESCE_WINDOW_MS)
+#else
+#define ZMK_KSCAN_BATCH_WINDOW K_NO_WAIT
+#endif
 
 struct zmk_kscan_event {
-    uint32_t row;
-    uint32_t column;
-    uint32_t state;
+    uint16_t row;
+    uint16_t column : 15;
+    uint16_t pressed : 1;
+    // Low 32 bits of the uptime in milliseconds when the transition was scanned
+    uint32_t timestamp;
 };
 
 struct zmk_kscan_msg_processor {
-    struct k_work work;
+    struct k_work_delayable work;
 } msg_processor;
 
-K_MSGQ_DEFINE(zmk_kscan_msgq, sizeof(struct zmk_kscan_event), CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, 4);
+/*
+ * Single-producer/single-consumer ring buffer between the kscan callback and the work item
+ * processing its events. The producer only advances head and the consumer only advances tail,
+ * so no lock is needed as long as a single kscan device reports events. One slot is kept free
+ * to tell a full ring from an empty one.
+ */
+#define KSCAN_RING_SLOTS (CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE + 1)
+
+static struct zmk_kscan_event kscan_ring[KSCAN_RING_SLOTS];
+static atomic_t kscan_ring_head;
+static atomic_t kscan_ring_tail;
+static atomic_t kscan_dropped_events;
+
+static inline atomic_val_t kscan_ring_next(atomic_val_t index) {
+    return (index + 1 == KSCAN_RING_SLOTS) ? 0 : index + 1;
+}
 
 static void zmk_kscan_callback(const struct device *dev, uint32_t row, uint32_t column,
                                bool pressed) {
-    struct zmk_kscan_event ev = {
-        .row = row,
-        .column = column,
-        .state = (pressed ? ZMK_KSCAN_EVENT_STATE_PRESSED : ZMK_KSCAN_EVENT_STATE_RELEASED)};
+    atomic_val_t head = atomic_get(&kscan_ring_head);
+    atomic_val_t next = kscan_ring_next(head);
+
+    if (next == atomic_get(&kscan_ring_tail)) {
+        atomic_inc(&kscan_dropped_events);
+    } else {
+        kscan_ring[head] = (struct zmk_kscan_event){
+            .row = row, .column = column, .pressed = pressed, .timestamp = k_uptime_get_32()};
+        atomic_set(&kscan_ring_head, next);
+    }
 
-    k_msgq_put(&zmk_kscan_msgq, &ev, K_NO_WAIT);
-    k_work_submit(&msg_processor.work);
+    k_work_schedule_for_queue(zmk_workqueue_input_work_q(), &msg_processor.work,
+                              ZMK_KSCAN_BATCH_WINDOW);
 }
 
-void zmk_kscan_process_msgq(struct k_work *item) {
-    struct zmk_kscan_event ev;
+void zmk_kscan_process_queue(struct k_work *item) {
+    static atomic_val_t reported_drops;
 
-    while (k_msgq_get(&zmk_kscan_msgq, &ev, K_NO_WAIT) == 0) {
-        bool pressed = (ev.state == ZMK_KSCAN_EVENT_STATE_PRESSED);
+    atomic_val_t drops = atomic_get(&kscan_dropped_events);
+    if (drops != reported_drops) {
+        LOG_WRN("KSCAN event queue overflowed, dropped %d events (%d total)",
+                (int)(drops - reported_drops), (int)drops);
+        reported_drops = drops;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+    zmk_endpoints_batch_begin();
+#endif
+
+    atomic_val_t tail = atomic_get(&kscan_ring_tail);
+    while (tail != atomic_get(&kscan_ring_head)) {
+        struct zmk_kscan_event ev = kscan_ring[tail];
+        tail = kscan_ring_next(tail);
+        atomic_set(&kscan_ring_tail, tail);
+
+        bool pressed = ev.pressed;
         int32_t position = zmk_matrix_transform_row_column_to_position(ev.row, ev.column);
 
         if (position < 0) {
@@ -55,14 +100,22 @@ void zmk_kscan_process_msgq(struct k_work *item) {
             continue;
         }
 
+        // Widen the capture time back to the 64 bit uptime, relative to now
+        int64_t now = k_uptime_get();
+        int64_t timestamp = now - (uint32_t)((uint32_t)now - ev.timestamp);
+
         LOG_DBG("Row: %d, col: %d, position: %d, pressed: %s", ev.row, ev.column, position,
                 (pressed ? "true" : "false"));
         ZMK_EVENT_RAISE(new_zmk_position_state_changed(
             (struct zmk_position_state_changed){.source = ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
                                                 .state = pressed,
                                                 .position = position,
-                                                .timestamp = k_uptime_get()}));
+                                                .timestamp = timestamp}));
     }
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+    zmk_endpoints_batch_end();
+#endif
 }
 
 int zmk_kscan_init(const struct device *dev) {
@@ -71,7 +124,7 @@ int zmk_kscan_init(const struct device *dev) {
         return -EINVAL;
     }
 
-    k_work_init(&msg_processor.work, zmk_kscan_process_msgq);
+    k_work_init_delayable(&msg_processor.work, zmk_kscan_process_queue);
 
     kscan_config(dev, zmk_kscan_callback);
     kscan_enable_callback(dev);
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#include <string.h>
+
+#include <zmk/latency_trace.h>
+#include <zmk/events/position_state_changed.h>
+
+#define MAX_HOPS CONFIG_ZMK_LATENCY_TRACE_LISTENERS
+
+// Deepest nesting of keymap dispatches that reports are attributed through
+#define MAX_ACTIVE_DEPTH 8
+
+struct latency_histogram {
+    uint32_t samples[CONFIG_ZMK_LATENCY_TRACE_SAMPLES];
+    uint16_t head;
+    uint16_t len;
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+};
+
+static const char *stage_names[ZMK_LATENCY_STAGE_COUNT] = {
+    [ZMK_LATENCY_STAGE_KEYMAP] = "keymap",
+    [ZMK_LATENCY_STAGE_REPORT] = "report",
+};
+
+static struct latency_histogram stages[ZMK_LATENCY_STAGE_COUNT];
+
+// One histogram per position event listener, in dispatch order
+static struct latency_histogram hops[MAX_HOPS];
+static const struct zmk_listener *hop_listeners[MAX_HOPS];
+
+// Creation times of the position events being dispatched by the keymap, innermost last. The
+// keymap may handle another position event while it is still processing one, e.g. when a
+// hold-tap releases the events it held back, so reports go to the innermost.
+static uint32_t active_created_at[MAX_ACTIVE_DEPTH];
+static uint8_t active_depth;
+
+// Creation time of the oldest position event whose report was held back until the end of its
+// kscan batch.
+static uint32_t deferred_created_at;
+static bool deferred;
+
+static void record(struct latency_histogram *hist, uint32_t created_at) {
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - created_at);
+
+    hist->samples[hist->head] = us;
+    hist->head = (hist->head + 1) % CONFIG_ZMK_LATENCY_TRACE_SAMPLES;
+    if (hist->len < CONFIG_ZMK_LATENCY_TRACE_SAMPLES) {
+        hist->len++;
+    }
+
+    if (hist->count == 0 || us < hist->min) {
+        hist->min = us;
+    }
+    if (us > hist->max) {
+        hist->max = us;
+    }
+    hist->count++;
+}
+
+void zmk_latency_trace_listener_hop(const zmk_event_t *eh, const struct zmk_listener *listener) {
+    if (as_zmk_position_state_changed(eh) == NULL) {
+        return;
+    }
+
+    int hop = eh->last_listener_index - eh->event->dispatch->first;
+    if (hop >= MAX_HOPS) {
+        return;
+    }
+
+    hop_listeners[hop] = listener;
+    record(&hops[hop], eh->created_at);
+}
+
+void zmk_latency_trace_keymap_begin(const zmk_event_t *eh) {
+    record(&stages[ZMK_LATENCY_STAGE_KEYMAP], eh->created_at);
+
+    if (active_depth < MAX_ACTIVE_DEPTH) {
+        active_created_at[active_depth] = eh->created_at;
+    }
+    active_depth++;
+}
+
+void zmk_latency_trace_keymap_end(void) {
+    if (active_depth > 0) {
+        active_depth--;
+    }
+}
+
+void zmk_latency_trace_report_deferred(void) {
+    if (active_depth == 0 || deferred) {
+        return;
+    }
+
+    deferred_created_at = active_created_at[MIN(active_depth, MAX_ACTIVE_DEPTH) - 1];
+    deferred = true;
+}
+
+void zmk_latency_trace_reports_flushed(void) { deferred = false; }
+
+void zmk_latency_trace_report_sent(void) {
+    if (active_depth > 0) {
+        record(&stages[ZMK_LATENCY_STAGE_REPORT],
+               active_created_at[MIN(active_depth, MAX_ACTIVE_DEPTH) - 1]);
+    } else if (deferred) {
+        record(&stages[ZMK_LATENCY_STAGE_REPORT], deferred_created_at);
+    }
+}
+
+static void sort_samples(uint32_t *samples, size_t len) {
+    for (int i = 1; i < len; i++) {
+        uint32_t sample = samples[i];
+        int j = i - 1;
+        for (; j >= 0 && samples[j] > sample; j--) {
+            samples[j + 1] = samples[j];
+        }
+        samples[j + 1] = sample;
+    }
+}
+
+// Nearest-rank percentile of the sorted samples
+static uint32_t percentile(const uint32_t *sorted, size_t len, int p) {
+    return sorted[(len * p + 99) / 100 - 1];
+}
+
+static void dump_histogram(const char *stage, const char *name,
+                           const struct latency_histogram *hist) {
+    static uint32_t sorted[CONFIG_ZMK_LATENCY_TRACE_SAMPLES];
+
+    if (hist->len == 0) {
+        printk("latency %s%s: no samples\n", stage, name);
+        return;
+    }
+
+    memcpy(sorted, hist->samples, hist->len * sizeof(uint32_t));
+    sort_samples(sorted, hist->len);
+
+    // Percentiles cover the last CONFIG_ZMK_LATENCY_TRACE_SAMPLES samples, min/max all of them
+    printk("latency %s%s: count %d min %d p50 %d p99 %d max %d us\n", stage, name, hist->count,
+           hist->min, percentile(sorted, hist->len, 50), percentile(sorted, hist->len, 99),
+           hist->max);
+}
+
+void zmk_latency_trace_dump(void) {
+    for (int i = 0; i < MAX_HOPS; i++) {
+        if (hop_listeners[i] != NULL) {
+            dump_histogram("listener ", hop_listeners[i]->name, &hops[i]);
+        }
+    }
+
+    for (int i = 0; i < ZMK_LATENCY_STAGE_COUNT; i++) {
+        dump_histogram(stage_names[i], "", &stages[i]);
+    }
+}
+
+#if IS_ENABLED(CONFIG_BOARD_NATIVE_POSIX) || IS_ENABLED(CONFIG_BOARD_NATIVE_POSIX_64BIT)
+
+#include <soc.h>
+
+// Dump the histograms when a native_posix test run exits so snapshots can check them
+NATIVE_TASK(zmk_latency_trace_dump, ON_EXIT, 1);
+
+#endif
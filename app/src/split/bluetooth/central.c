@@ -24,9 +24,11 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/sensors.h>
 #include <zmk/split/bluetooth/uuid.h>
 #include <zmk/split/bluetooth/service.h>
+#include <zmk/endpoints.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/sensor_event.h>
+#include <zmk/workqueue.h>
 
 static int start_scanning(void);
 
@@ -61,10 +63,19 @@ K_MSGQ_DEFINE(peripheral_event_msgq, sizeof(struct zmk_position_state_changed),
 
 void peripheral_event_work_callback(struct k_work *work) {
     struct zmk_position_state_changed ev;
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+    zmk_endpoints_batch_begin();
+#endif
+
     while (k_msgq_get(&peripheral_event_msgq, &ev, K_NO_WAIT) == 0) {
         LOG_DBG("Trigger key position state change for %d", ev.position);
         ZMK_EVENT_RAISE(new_zmk_position_state_changed(ev));
     }
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_COALESCE_REPORTS)
+    zmk_endpoints_batch_end();
+#endif
 }
 
 K_WORK_DEFINE(peripheral_event_work, peripheral_event_work_callback);
@@ -118,7 +129,7 @@ int release_peripheral_slot(int index) {
                                                         .timestamp = k_uptime_get()};
 
                 k_msgq_put(&peripheral_event_msgq, &ev, K_NO_WAIT);
-                k_work_submit(&peripheral_event_work);
+                k_work_submit_to_queue(zmk_workqueue_input_work_q(), &peripheral_event_work);
             }
         }
     }
@@ -208,7 +219,7 @@ static uint8_t split_central_sensor_notify_func(struct bt_conn *conn,
     memcpy(ev.channel_data, sensor_event.channel_data,
            sizeof(struct zmk_sensor_channel_data) * sensor_event.channel_data_size);
     k_msgq_put(&peripheral_sensor_event_msgq, &ev, K_NO_WAIT);
-    k_work_submit(&peripheral_sensor_event_work);
+    k_work_submit_to_queue(zmk_workqueue_input_work_q(), &peripheral_sensor_event_work);
 
     return BT_GATT_ITER_CONTINUE;
 }
@@ -250,7 +261,7 @@ static uint8_t split_central_notify_func(struct bt_conn *conn,
                                                         .timestamp = k_uptime_get()};
 
                 k_msgq_put(&peripheral_event_msgq, &ev, K_NO_WAIT);
-                k_work_submit(&peripheral_event_work);
+                k_work_submit_to_queue(zmk_workqueue_input_work_q(), &peripheral_event_work);
             }
         }
     }
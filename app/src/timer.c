@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2023 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/timer.h>
+#include <zmk/workqueue.h>
+
+#define WHEEL_SLOTS CONFIG_ZMK_TIMER_WHEEL_SLOTS
+#define TICK_MS CONFIG_ZMK_TIMER_WHEEL_TICK_MS
+
+#define TICK(deadline) ((deadline) / TICK_MS)
+#define SLOT(tick) (&wheel[(tick) % WHEEL_SLOTS])
+
+// Running timers sit in the slot of the tick their deadline falls in. Deadlines more than one
+// rotation away share a slot with nearer ones and are skipped until their turn comes.
+static sys_dlist_t wheel[WHEEL_SLOTS];
+static struct k_spinlock lock;
+// Includes expired timers whose handlers have yet to be called, those can still be stopped.
+static uint32_t running_count;
+
+// Every tick up to (but not including) processed_tick has been expired.
+static int64_t processed_tick;
+// The deadline the kernel timeout is currently scheduled for.
+static int64_t scheduled_deadline = INT64_MAX;
+
+static void timer_wheel_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(timer_wheel_work, timer_wheel_work_handler);
+
+static void schedule_locked(int64_t deadline) {
+    if (deadline >= scheduled_deadline) {
+        return;
+    }
+
+    scheduled_deadline = deadline;
+    k_work_reschedule_for_queue(zmk_workqueue_input_work_q(), &timer_wheel_work,
+                                K_MSEC(MAX(deadline - k_uptime_get(), 0)));
+}
+
+void zmk_timer_init(struct zmk_timer *timer, zmk_timer_handler_t handler) {
+    sys_dnode_init(&timer->node);
+    timer->handler = handler;
+}
+
+void zmk_timer_start(struct zmk_timer *timer, int64_t deadline) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (sys_dnode_is_linked(&timer->node)) {
+        sys_dlist_remove(&timer->node);
+    } else {
+        running_count++;
+    }
+
+    // Expired deadlines go in the first slot that has yet to be processed.
+    timer->deadline = deadline;
+    sys_dlist_append(SLOT(MAX(TICK(deadline), processed_tick)), &timer->node);
+    schedule_locked(deadline);
+
+    k_spin_unlock(&lock, key);
+}
+
+bool zmk_timer_stop(struct zmk_timer *timer) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    // The kernel timeout is left as is, waking up for a stopped timer just finds nothing to do.
+    bool running = sys_dnode_is_linked(&timer->node);
+    if (running) {
+        sys_dlist_remove(&timer->node);
+        running_count--;
+    }
+
+    k_spin_unlock(&lock, key);
+    return running;
+}
+
+static void expire_slot_locked(sys_dlist_t *slot, int64_t now, sys_dlist_t *expired) {
+    struct zmk_timer *timer, *next;
+    SYS_DLIST_FOR_EACH_CONTAINER_SAFE(slot, timer, next, node) {
+        if (timer->deadline <= now) {
+            sys_dlist_remove(&timer->node);
+            sys_dlist_append(expired, &timer->node);
+        }
+    }
+}
+
+// Find the earliest deadline within the next rotation, or the end of it if there is none, so far
+// away timers are checked on again once their slot comes around.
+static int64_t next_deadline_locked(int64_t now_tick) {
+    for (int64_t tick = now_tick; tick < now_tick + WHEEL_SLOTS; tick++) {
+        int64_t earliest = INT64_MAX;
+        struct zmk_timer *timer;
+        SYS_DLIST_FOR_EACH_CONTAINER(SLOT(tick), timer, node) {
+            if (TICK(timer->deadline) <= tick) {
+                earliest = MIN(earliest, timer->deadline);
+            }
+        }
+        if (earliest != INT64_MAX) {
+            return earliest;
+        }
+    }
+    return (now_tick + WHEEL_SLOTS) * TICK_MS;
+}
+
+static void timer_wheel_work_handler(struct k_work *work) {
+    int64_t now = k_uptime_get();
+    int64_t now_tick = TICK(now);
+    sys_dlist_t expired;
+    sys_dlist_init(&expired);
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    // Expire every slot passed since the last run in one go. The current tick's slot may still
+    // hold timers due later in the tick, so it is processed again next time.
+    int64_t first_tick = MAX(processed_tick, now_tick - WHEEL_SLOTS + 1);
+    for (int64_t tick = first_tick; tick <= now_tick; tick++) {
+        expire_slot_locked(SLOT(tick), now, &expired);
+    }
+    processed_tick = now_tick;
+    scheduled_deadline = INT64_MAX;
+
+    // Handlers may stop timers that expired in the same batch or start them again, including their
+    // own, so each timer is unlinked right before its handler is called.
+    sys_dnode_t *node;
+    while ((node = sys_dlist_get(&expired)) != NULL) {
+        running_count--;
+        k_spin_unlock(&lock, key);
+
+        struct zmk_timer *timer = CONTAINER_OF(node, struct zmk_timer, node);
+        timer->handler(timer);
+
+        key = k_spin_lock(&lock);
+    }
+
+    if (running_count > 0) {
+        schedule_locked(next_deadline_locked(now_tick));
+    }
+
+    k_spin_unlock(&lock, key);
+}
+
+static int timer_wheel_init(const struct device *_arg) {
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+        sys_dlist_init(&wheel[i]);
+    }
+    processed_tick = TICK(k_uptime_get());
+    return 0;
+}
+
+SYS_INIT(timer_wheel_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -13,6 +13,7 @@
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
 #include <zmk/event_manager.h>
+#include <zmk/workqueue.h>
 #include <zmk/events/usb_conn_state_changed.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
@@ -48,7 +49,7 @@ enum zmk_usb_conn_state zmk_usb_get_conn_state() {
 
 void usb_status_cb(enum usb_dc_status_code status, const uint8_t *params) {
     usb_status = status;
-    k_work_submit(&usb_status_notifier_work);
+    k_work_submit_to_queue(zmk_workqueue_input_work_q(), &usb_status_notifier_work);
 };
 
 static int zmk_usb_init(const struct device *_arg) {
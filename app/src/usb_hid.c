@@ -6,27 +6,148 @@
 
 #include <zephyr/device.h>
 #include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
 
 #include <zephyr/usb/usb_device.h>
 #include <zephyr/usb/class/usb_hid.h>
 
 #include <zmk/usb.h>
+#include <zmk/usb_hid.h>
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
 #include <zmk/event_manager.h>
+#include <zmk/events/usb_conn_state_changed.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+#define QUEUE_SIZE CONFIG_ZMK_USB_HID_REPORT_QUEUE_SIZE
+
+#define MAX_REPORT_SIZE                                                                            \
+    MAX(MAX(sizeof(struct zmk_hid_keyboard_report), sizeof(struct zmk_hid_consumer_report)),       \
+        sizeof(struct zmk_hid_mouse_report))
+
+// How long to wait for the host to pick up a report before assuming the IN ready callback was lost
+#define IN_READY_TIMEOUT_MS 30
+
+struct queued_report {
+    uint8_t len;
+    uint8_t data[MAX_REPORT_SIZE];
+};
+
 static const struct device *hid_dev;
 
-static K_SEM_DEFINE(hid_sem, 1, 1);
+// Reports wait here while the interrupt IN endpoint is busy and go out one by one from the IN
+// ready callback, so callers never wait for the host to poll.
+static struct k_spinlock lock;
+static struct queued_report queue[QUEUE_SIZE];
+// Free running sequence numbers, reports [queue_head, queue_tail) are waiting to be sent
+static uint32_t queue_head;
+static uint32_t queue_tail;
+// Whether a report was written to the endpoint that the host has yet to pick up
+static bool in_busy;
+static int64_t in_busy_since;
+// Queued reports are copied here before being written, as their slot may be reused right after
+static uint8_t tx_report[MAX_REPORT_SIZE];
+// Counted atomically, as they are read from the shell thread
+static atomic_t stalls;
+static atomic_t coalesced;
+
+static void send_next_report(void) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (queue_head == queue_tail) {
+        in_busy = false;
+        k_spin_unlock(&lock, key);
+        return;
+    }
+
+    struct queued_report *next = &queue[queue_head++ % QUEUE_SIZE];
+    uint8_t len = next->len;
+    memcpy(tx_report, next->data, len);
+    in_busy = true;
+    in_busy_since = k_uptime_get();
 
-static void in_ready_cb(const struct device *dev) { k_sem_give(&hid_sem); }
+    k_spin_unlock(&lock, key);
+
+    int err = hid_int_ep_write(hid_dev, tx_report, len, NULL);
+    if (err) {
+        LOG_ERR("Failed to send queued report (%d)", err);
+        key = k_spin_lock(&lock);
+        in_busy = false;
+        k_spin_unlock(&lock, key);
+    }
+}
+
+static void in_ready_cb(const struct device *dev) { send_next_report(); }
 
 static const struct hid_ops ops = {
     .int_in_ready = in_ready_cb,
 };
 
+// Mouse reports carry relative movement, so two identical ones move the pointer twice. Once the
+// queue is full, a mouse report is added into the newest queued one if the same buttons are held.
+static bool merge_mouse_report(struct queued_report *queued, const uint8_t *report, size_t len) {
+    if (queued->len != len || len != sizeof(struct zmk_hid_mouse_report)) {
+        return false;
+    }
+
+    struct zmk_hid_mouse_report *into = (struct zmk_hid_mouse_report *)queued->data;
+    const struct zmk_hid_mouse_report *from = (const struct zmk_hid_mouse_report *)report;
+    if (into->body.buttons != from->body.buttons) {
+        return false;
+    }
+
+    into->body.x = CLAMP(into->body.x + from->body.x, INT16_MIN, INT16_MAX);
+    into->body.y = CLAMP(into->body.y + from->body.y, INT16_MIN, INT16_MAX);
+    into->body.scroll_x = CLAMP(into->body.scroll_x + from->body.scroll_x, INT8_MIN, INT8_MAX);
+    into->body.scroll_y = CLAMP(into->body.scroll_y + from->body.scroll_y, INT8_MIN, INT8_MAX);
+    return true;
+}
+
+// Keyboard and consumer reports of the same ID are coalesced: a report identical to the newest one
+// of its ID still waiting is left out, and once the queue is full the newest one of its ID is
+// replaced. Mouse reports are never left out, only merged as above.
+static int queue_report_locked(const uint8_t *report, size_t len) {
+    bool is_mouse = report[0] == ZMK_HID_REPORT_ID_MOUSE;
+    struct queued_report *same_id = NULL;
+    for (uint32_t seq = queue_tail; seq != queue_head; seq--) {
+        struct queued_report *queued = &queue[(seq - 1) % QUEUE_SIZE];
+        if (queued->data[0] == report[0]) {
+            same_id = queued;
+            break;
+        }
+    }
+
+    if (!is_mouse && same_id != NULL && same_id->len == len &&
+        memcmp(same_id->data, report, len) == 0) {
+        atomic_inc(&coalesced);
+        return 0;
+    }
+
+    if (queue_tail - queue_head < QUEUE_SIZE) {
+        struct queued_report *queued = &queue[queue_tail++ % QUEUE_SIZE];
+        queued->len = len;
+        memcpy(queued->data, report, len);
+        return 0;
+    }
+
+    if (same_id != NULL && is_mouse && merge_mouse_report(same_id, report, len)) {
+        atomic_inc(&coalesced);
+        return 0;
+    }
+
+    if (same_id != NULL && !is_mouse) {
+        same_id->len = len;
+        memcpy(same_id->data, report, len);
+        atomic_inc(&coalesced);
+        return 0;
+    }
+
+    LOG_WRN("USB HID report queue full, dropping report %d", report[0]);
+    return -ENOMEM;
+}
+
 int zmk_usb_hid_send_report(const uint8_t *report, size_t len) {
     switch (zmk_usb_get_status()) {
     case USB_DC_SUSPEND:
@@ -37,17 +158,92 @@ int zmk_usb_hid_send_report(const uint8_t *report, size_t len) {
     case USB_DC_UNKNOWN:
         return -ENODEV;
     default:
-        k_sem_take(&hid_sem, K_MSEC(30));
-        int err = hid_int_ep_write(hid_dev, report, len, NULL);
+        break;
+    }
 
+    if (len > MAX_REPORT_SIZE) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (in_busy && k_uptime_get() - in_busy_since > IN_READY_TIMEOUT_MS) {
+        LOG_WRN("Host did not pick up the last report, sending anyway");
+        in_busy = false;
+    }
+
+    if (!in_busy && queue_head == queue_tail) {
+        in_busy = true;
+        in_busy_since = k_uptime_get();
+        k_spin_unlock(&lock, key);
+
+        int err = hid_int_ep_write(hid_dev, report, len, NULL);
         if (err) {
-            k_sem_give(&hid_sem);
+            key = k_spin_lock(&lock);
+            in_busy = false;
+            k_spin_unlock(&lock, key);
         }
-
         return err;
     }
+
+    if (in_busy) {
+        atomic_inc(&stalls);
+    }
+
+    int err = queue_report_locked(report, len);
+    bool idle = !in_busy;
+
+    k_spin_unlock(&lock, key);
+
+    // Reports may be left over from a failed write, with nothing to send them once the endpoint
+    // is ready again.
+    if (idle) {
+        send_next_report();
+    }
+
+    return err;
 }
 
+void zmk_usb_hid_get_stats(struct zmk_usb_hid_stats *out) {
+    out->stalls = atomic_get(&stalls);
+    out->coalesced = atomic_get(&coalesced);
+}
+
+void zmk_usb_hid_print_stats(void) {
+    printk("USB HID: %ld stalls, %ld reports coalesced\n", (long)atomic_get(&stalls),
+           (long)atomic_get(&coalesced));
+}
+
+#if IS_ENABLED(CONFIG_SHELL)
+
+#include <zephyr/shell/shell.h>
+
+static int cmd_usb_hid_stats(const struct shell *sh, size_t argc, char **argv) {
+    zmk_usb_hid_print_stats();
+    return 0;
+}
+
+SHELL_CMD_REGISTER(zmk_usb_hid, NULL, "Print USB HID report queue counters", cmd_usb_hid_stats);
+
+#endif /* IS_ENABLED(CONFIG_SHELL) */
+
+static int usb_hid_listener(const zmk_event_t *eh) {
+    if (zmk_usb_is_hid_ready()) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    // Whatever was queued or in flight is gone with the connection.
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    queue_head = queue_tail;
+    in_busy = false;
+    k_spin_unlock(&lock, key);
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(usb_hid, usb_hid_listener);
+ZMK_SUBSCRIPTION(usb_hid, zmk_usb_conn_state_changed);
+
 static int zmk_usb_hid_init(const struct device *_arg) {
     hid_dev = device_get_binding("HID_0");
     if (hid_dev == NULL) {
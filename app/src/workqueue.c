@@ -6,6 +6,9 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/workqueue.h>
 
@@ -13,14 +16,69 @@ K_THREAD_STACK_DEFINE(lowprio_q_stack, CONFIG_ZMK_LOW_PRIORITY_THREAD_STACK_SIZE
 
 static struct k_work_q lowprio_work_q;
 
+#if IS_ENABLED(CONFIG_ZMK_INPUT_WORK_QUEUE_DEDICATED)
+K_THREAD_STACK_DEFINE(input_q_stack, CONFIG_ZMK_INPUT_DEDICATED_THREAD_STACK_SIZE);
+
+static struct k_work_q input_work_q;
+#endif
+
 struct k_work_q *zmk_workqueue_lowprio_work_q() {
     return &lowprio_work_q;
 }
 
+struct k_work_q *zmk_workqueue_input_work_q() {
+#if IS_ENABLED(CONFIG_ZMK_INPUT_WORK_QUEUE_DEDICATED)
+    return &input_work_q;
+#else
+    return &k_sys_work_q;
+#endif
+}
+
+#if IS_ENABLED(CONFIG_ZMK_WORKQUEUE_STACK_REPORT)
+
+static void log_stack_usage(const char *name, struct k_work_q *queue) {
+    size_t unused;
+    int err = k_thread_stack_space_get(&queue->thread, &unused);
+    if (err) {
+        LOG_WRN("Unable to get stack usage for %s (%d)", name, err);
+        return;
+    }
+
+    LOG_INF("%s stack: %d of %d bytes used", name,
+            (int)(queue->thread.stack_info.size - unused), (int)queue->thread.stack_info.size);
+}
+
+static void stack_report_work_handler(struct k_work *work) {
+    log_stack_usage("System work queue", &k_sys_work_q);
+    log_stack_usage("Low priority work queue", &lowprio_work_q);
+#if IS_ENABLED(CONFIG_ZMK_INPUT_WORK_QUEUE_DEDICATED)
+    log_stack_usage("Input work queue", &input_work_q);
+#endif
+
+    k_work_schedule_for_queue(&lowprio_work_q, k_work_delayable_from_work(work),
+                              K_SECONDS(CONFIG_ZMK_WORKQUEUE_STACK_REPORT_INTERVAL));
+}
+
+static K_WORK_DELAYABLE_DEFINE(stack_report_work, stack_report_work_handler);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_WORKQUEUE_STACK_REPORT) */
+
 static int workqueue_init() {
     static const struct k_work_queue_config queue_config = {.name = "Low Priority Work Queue"};
     k_work_queue_start(&lowprio_work_q, lowprio_q_stack, K_THREAD_STACK_SIZEOF(lowprio_q_stack),
                        CONFIG_ZMK_LOW_PRIORITY_THREAD_PRIORITY, &queue_config);
+
+#if IS_ENABLED(CONFIG_ZMK_INPUT_WORK_QUEUE_DEDICATED)
+    static const struct k_work_queue_config input_queue_config = {.name = "Input Work Queue"};
+    k_work_queue_start(&input_work_q, input_q_stack, K_THREAD_STACK_SIZEOF(input_q_stack),
+                       CONFIG_ZMK_INPUT_DEDICATED_THREAD_PRIORITY, &input_queue_config);
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_WORKQUEUE_STACK_REPORT)
+    k_work_schedule_for_queue(&lowprio_work_q, &stack_report_work,
+                              K_SECONDS(CONFIG_ZMK_WORKQUEUE_STACK_REPORT_INTERVAL));
+#endif
+
     return 0;
 }
 